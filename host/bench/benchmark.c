@@ -0,0 +1,232 @@
+/* Benchmark
+ * By: John Jekel
+ *
+ * Runs the whole firmware (see system.h) through a fixed scenario and measures the cost of each
+ * kind of wake: awake cycles and I2C bytes per wake for CLOCK_update, CLOCK_setup (waking from
+ * SLEEP), MENU_update for each button and the ringing alarm, and awake cycles and I2C bytes for a
+ * simulated hour of SLEEP. Each metric is compared against the budget file given as the argument;
+ * the benchmark fails if any metric is over its budget (or has none).
+ *
+ * NOTE: Cycles are the HAL's estimate: I2C, EEPROM and timer waits are exact, but code between
+ *  register accesses is counted as HAL_CYCLES_PER_ACCESS (see hal.h), so cycles mostly measure
+ *  time spent waiting on peripherals.
+*/
+
+#include "hal.h"
+#include "ds3231.h"
+#include "hd44780.h"
+#include "system.h"
+
+#include "settings.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Constants/Macros */
+
+#define SECOND SYSTEM_CYCLES_PER_SECOND
+#define MS SYSTEM_CYCLES_PER_MS
+
+#define MAX_METRICS 32
+#define HOLD_TIME (100 * MS)
+
+/* Typedefs */
+
+typedef struct
+{
+    uint64_t awakeCycles;
+    uint32_t wakeups;
+    uint32_t i2cBytes;
+} snapshot_t;
+
+typedef struct
+{
+    char name[48];
+    uint64_t value;
+} metric_t;
+
+/* Static Variables */
+
+//Thursday 2023-06-15 07:59:30; the alarm is set for 08:01 (rings 90 seconds in)
+static const uint8_t startTime[7] = {0x30, 0x59, 0x07, 0x04, 0x15, 0x06, 0x23};
+
+static metric_t metrics[MAX_METRICS];
+static uint8_t metricCount;
+
+/* Static Function Declarations */
+
+static snapshot_t takeSnapshot();
+static void addMetrics(const char* name, snapshot_t before, snapshot_t after, bool perWake);
+static void addMetric(const char* name, const char* unit, uint64_t value);
+static void measureWindow(const char* name, uint64_t start, uint64_t end);
+static void measurePress(const char* name, uint8_t buttons, uint64_t at);
+static bool checkBudgets(const char* path);
+
+/* Functions */
+
+int main(int argc, char** argv)
+{
+    SYSTEM_boot(startTime);
+    uint8_t* rtc = DS3231_getRegisters();
+    rtc[0xB] = 0x01;//Alarm 2 minutes
+    rtc[0xC] = 0x08;//Alarm 2 hours
+
+    //Boot (splash screen, then CLOCK mode); seconds tick at 0.5s, 1.5s, 2.5s, etc.
+    SYSTEM_runUntil(1 * SECOND);
+    SETTINGS_data.alarmEnabled = true;
+
+    //CLOCK_update (one tick in each window)
+    measureWindow("clock_update", (2 * SECOND) + (450 * MS), (5 * SECOND) + (450 * MS));
+
+    //Timed out into SLEEP by now; a push and release go back to CLOCK (CLOCK_setup)
+    measurePress("clock_setup", SYSTEM_ENTER, (8 * SECOND) + (600 * MS));
+
+    //Pushing a button in CLOCK opens the MENU, then each button does something different
+    measurePress("menu_setup", SYSTEM_ENTER, (9 * SECOND) + (600 * MS));
+    measurePress("menu_right", SYSTEM_RIGHT, (10 * SECOND) + (600 * MS));
+    measurePress("menu_left", SYSTEM_LEFT, (11 * SECOND) + (600 * MS));
+    measurePress("menu_up", SYSTEM_UP, (12 * SECOND) + (600 * MS));
+    measurePress("menu_down", SYSTEM_DOWN, (13 * SECOND) + (600 * MS));
+    measurePress("menu_enter", SYSTEM_ENTER, (14 * SECOND) + (600 * MS));
+    measurePress("menu_exit", SYSTEM_EXIT, (15 * SECOND) + (600 * MS));//Saves the settings
+
+    //The alarm rings in SLEEP; a button push silences it
+    measureWindow("alarm_update", 92 * SECOND, 102 * SECOND);
+    char line[17];
+    HD44780_getLine(0, line);
+    bool rang = strstr(line, "Alarm!") != NULL;
+    SYSTEM_press(SYSTEM_ENTER, HOLD_TIME);
+
+    //An hour of SLEEP (POWER_ACCOUNTING's scheduler timer wakes it, so that has its own budgets)
+    SYSTEM_runUntil(120 * SECOND);
+    snapshot_t before = takeSnapshot();
+    SYSTEM_runUntil((120 + 3600) * SECOND);
+    #ifdef POWER_ACCOUNTING
+        addMetrics("sleep_hour_power_accounting", before, takeSnapshot(), false);
+    #else
+        addMetrics("sleep_hour", before, takeSnapshot(), false);
+    #endif
+
+    for (uint8_t i = 0; i < metricCount; ++i)
+        printf("%-40s %12llu\n", metrics[i].name, (unsigned long long)metrics[i].value);
+
+    if (!rang)
+    {
+        printf("The alarm never rang\n");
+        return 1;
+    }
+
+    if (argc < 2)
+        return 0;//Nothing to compare against
+
+    return checkBudgets(argv[1]) ? 0 : 1;
+}
+
+/* Static Functions */
+
+static snapshot_t takeSnapshot()
+{
+    const HAL_stats_t* stats = HAL_getStats();
+    return (snapshot_t){stats->awakeCycles, stats->powerDownWakeups, stats->i2cBytes};
+}
+
+static void addMetrics(const char* name, snapshot_t before, snapshot_t after, bool perWake)
+{
+    uint64_t cycles = after.awakeCycles - before.awakeCycles;
+    uint64_t bytes = after.i2cBytes - before.i2cBytes;
+    uint32_t wakeups = after.wakeups - before.wakeups;
+
+    if (perWake)
+    {
+        if (!wakeups)
+            wakeups = 1;//Reported as the total
+
+        addMetric(name, "cycles_per_wake", cycles / wakeups);
+        addMetric(name, "i2c_bytes_per_wake", bytes / wakeups);
+    }
+    else
+    {
+        addMetric(name, "awake_cycles", cycles);
+        addMetric(name, "i2c_bytes", bytes);
+        addMetric(name, "wakeups", wakeups);
+    }
+}
+
+static void addMetric(const char* name, const char* unit, uint64_t value)
+{
+    if (metricCount == MAX_METRICS)
+        return;
+
+    snprintf(metrics[metricCount].name, sizeof(metrics[metricCount].name), "%s.%s", name, unit);
+    metrics[metricCount].value = value;
+    ++metricCount;
+}
+
+static void measureWindow(const char* name, uint64_t start, uint64_t end)
+{
+    SYSTEM_runUntil(start);
+    snapshot_t before = takeSnapshot();
+    SYSTEM_runUntil(end);
+    addMetrics(name, before, takeSnapshot(), true);
+}
+
+static void measurePress(const char* name, uint8_t buttons, uint64_t at)//Push and release
+{
+    SYSTEM_runUntil(at);
+    snapshot_t before = takeSnapshot();
+    SYSTEM_press(buttons, HOLD_TIME);
+    SYSTEM_runFor(HOLD_TIME);
+    addMetrics(name, before, takeSnapshot(), true);
+}
+
+static bool checkBudgets(const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        printf("Can't open %s\n", path);
+        return false;
+    }
+
+    bool budgeted[MAX_METRICS] = {false};
+    bool passed = true;
+    char line[128];
+
+    while (fgets(line, sizeof(line), file))
+    {
+        char name[48];
+        unsigned long long budget;
+
+        if ((line[0] == '#') || (sscanf(line, "%47s %llu", name, &budget) != 2))
+            continue;//Comment or blank
+
+        for (uint8_t i = 0; i < metricCount; ++i)
+        {
+            if (strcmp(metrics[i].name, name))
+                continue;
+
+            budgeted[i] = true;
+            if (metrics[i].value > budget)
+            {
+                printf("OVER BUDGET: %s is %llu (budget %llu)\n", name,
+                       (unsigned long long)metrics[i].value, budget);
+                passed = false;
+            }
+        }
+    }
+
+    fclose(file);
+
+    for (uint8_t i = 0; i < metricCount; ++i)
+    {
+        if (!budgeted[i])
+        {
+            printf("NO BUDGET: %s\n", metrics[i].name);
+            passed = false;
+        }
+    }
+
+    return passed;
+}
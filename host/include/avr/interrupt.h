@@ -0,0 +1,28 @@
+/* Host avr/interrupt.h
+ * By: John Jekel
+ *
+ * ISRs become ordinary functions named after their vector, which hal.c calls when the simulated
+ * interrupt fires. cli and sei change the I bit of the simulated SREG.
+*/
+
+#ifndef HOST_AVR_INTERRUPT_H
+#define HOST_AVR_INTERRUPT_H
+
+void HAL_cli();
+void HAL_sei();
+
+#define cli() HAL_cli()
+#define sei() HAL_sei()
+
+#define ISR(vector, ...) void vector(void); void vector(void)
+
+//Vectors used by the firmware (defined weakly by hal.c, so unused ones may be left out)
+void INT0_vect(void);
+void PCINT2_vect(void);
+void WDT_vect(void);
+void TIMER2_COMPA_vect(void);
+void TIMER0_OVF_vect(void);
+void EE_READY_vect(void);
+void TWI_vect(void);
+
+#endif//HOST_AVR_INTERRUPT_H
@@ -0,0 +1,110 @@
+/* Host avr/io.h
+ * By: John Jekel
+ *
+ * Stands in for avr-libc's <avr/io.h> in the host build. Each register is a byte in a simulated
+ * data space (at the same addresses as on the atmega328p); every access goes through HAL_access,
+ * which lets the models in hal.c run (and interrupts fire) between accesses like on real hardware.
+ * Only the registers and bits the firmware uses are defined.
+*/
+
+#ifndef HOST_AVR_IO_H
+#define HOST_AVR_IO_H
+
+#include <stdint.h>
+
+volatile uint8_t* HAL_access(uint8_t address);
+
+#define _SFR_MEM8(address) (*HAL_access(address))
+
+/* Memory */
+
+#define E2END   0x3FF
+
+/* Ports */
+
+#define PINB    _SFR_MEM8(0x23)
+#define DDRB    _SFR_MEM8(0x24)
+#define PORTB   _SFR_MEM8(0x25)
+#define PINC    _SFR_MEM8(0x26)
+#define DDRC    _SFR_MEM8(0x27)
+#define PORTC   _SFR_MEM8(0x28)
+#define PIND    _SFR_MEM8(0x29)
+#define DDRD    _SFR_MEM8(0x2A)
+#define PORTD   _SFR_MEM8(0x2B)
+
+/* Interrupt Flags and Masks */
+
+#define TIFR0   _SFR_MEM8(0x35)
+#define TIFR1   _SFR_MEM8(0x36)
+#define TIFR2   _SFR_MEM8(0x37)
+#define PCIFR   _SFR_MEM8(0x3B)
+#define EIFR    _SFR_MEM8(0x3C)
+#define EIMSK   _SFR_MEM8(0x3D)
+#define PCICR   _SFR_MEM8(0x68)
+#define EICRA   _SFR_MEM8(0x69)
+#define PCMSK0  _SFR_MEM8(0x6B)
+#define PCMSK1  _SFR_MEM8(0x6C)
+#define PCMSK2  _SFR_MEM8(0x6D)
+#define TIMSK0  _SFR_MEM8(0x6E)
+#define TIMSK1  _SFR_MEM8(0x6F)
+#define TIMSK2  _SFR_MEM8(0x70)
+
+/* EEPROM */
+
+#define EECR    _SFR_MEM8(0x3F)
+#define EEDR    _SFR_MEM8(0x40)
+#define EEARL   _SFR_MEM8(0x41)
+#define EEARH   _SFR_MEM8(0x42)
+
+#define EERE    0
+#define EEPE    1
+#define EEMPE   2
+#define EERIE   3
+
+/* Timers */
+
+#define GTCCR   _SFR_MEM8(0x43)
+#define TCCR0A  _SFR_MEM8(0x44)
+#define TCCR0B  _SFR_MEM8(0x45)
+#define TCNT0   _SFR_MEM8(0x46)
+#define OCR0A   _SFR_MEM8(0x47)
+#define TCCR1A  _SFR_MEM8(0x80)
+#define TCCR1B  _SFR_MEM8(0x81)
+#define TCNT1L  _SFR_MEM8(0x84)
+#define TCNT1H  _SFR_MEM8(0x85)
+#define OCR1AL  _SFR_MEM8(0x88)
+#define OCR1AH  _SFR_MEM8(0x89)
+#define TCCR2A  _SFR_MEM8(0xB0)
+#define TCCR2B  _SFR_MEM8(0xB1)
+#define TCNT2   _SFR_MEM8(0xB2)
+#define OCR2A   _SFR_MEM8(0xB3)
+#define ASSR    _SFR_MEM8(0xB6)
+
+/* System */
+
+#define ACSR    _SFR_MEM8(0x50)
+#define SMCR    _SFR_MEM8(0x53)
+#define MCUSR   _SFR_MEM8(0x54)
+#define MCUCR   _SFR_MEM8(0x55)
+#define SREG    _SFR_MEM8(0x5F)
+#define WDTCSR  _SFR_MEM8(0x60)
+#define PRR     _SFR_MEM8(0x64)
+#define DIDR0   _SFR_MEM8(0x7E)
+
+/* TWI */
+
+#define TWBR    _SFR_MEM8(0xB8)
+#define TWSR    _SFR_MEM8(0xB9)
+#define TWAR    _SFR_MEM8(0xBA)
+#define TWDR    _SFR_MEM8(0xBB)
+#define TWCR    _SFR_MEM8(0xBC)
+
+#define TWIE    0
+#define TWEN    2
+#define TWWC    3
+#define TWSTO   4
+#define TWSTA   5
+#define TWEA    6
+#define TWINT   7
+
+#endif//HOST_AVR_IO_H
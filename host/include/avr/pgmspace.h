@@ -0,0 +1,22 @@
+/* Host avr/pgmspace.h
+ * By: John Jekel
+ *
+ * There is only one address space on the host, so program space is ordinary (const) memory.
+*/
+
+#ifndef HOST_AVR_PGMSPACE_H
+#define HOST_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(string) (string)
+
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) (*(const uint16_t*)(address))
+#define pgm_read_ptr(address) (*(void* const*)(address))
+#define memcpy_P memcpy
+
+#endif//HOST_AVR_PGMSPACE_H
@@ -0,0 +1,14 @@
+/* Host avr/sleep.h
+ * By: John Jekel
+ *
+ * sleep_cpu advances simulated time until an interrupt fires (see HAL_sleep).
+*/
+
+#ifndef HOST_AVR_SLEEP_H
+#define HOST_AVR_SLEEP_H
+
+void HAL_sleep();
+
+#define sleep_cpu() HAL_sleep()
+
+#endif//HOST_AVR_SLEEP_H
@@ -0,0 +1,12 @@
+/* Host avr/wdt.h
+ * By: John Jekel
+*/
+
+#ifndef HOST_AVR_WDT_H
+#define HOST_AVR_WDT_H
+
+void HAL_wdr();
+
+#define wdt_reset() HAL_wdr()
+
+#endif//HOST_AVR_WDT_H
@@ -0,0 +1,26 @@
+/* DS3231 model
+ * By: John Jekel
+ *
+ * A DS3231 RTC for the host build's I2C bus: the 19 registers (with the pointer auto-incrementing
+ * and wrapping like the real chip), timekeeping in BCD (24 hour time; every 4th year is a leap
+ * year), both alarms with their mask bits, and the ~INT/SQW pin (the 1hz square wave or the alarm
+ * interrupt, depending on INTCN) driven onto PD2.
+*/
+
+#ifndef DS3231_H
+#define DS3231_H
+
+#include <stdint.h>
+
+/* Constants/Macros */
+
+#define DS3231_ADDRESS 0x68
+
+/* Functions */
+
+void DS3231_attach();//Call after HAL_reset; the time starts at 2000-01-01 (Saturday) 00:00:00
+uint8_t* DS3231_getRegisters();//Direct access to all 19 registers (eg. to set the time)
+uint32_t DS3231_getSecondsElapsed();//Seconds ticked since DS3231_attach
+void DS3231_freeze();//Stops timekeeping and stops driving PD2 (the registers still work over I2C)
+
+#endif//DS3231_H
@@ -0,0 +1,98 @@
+/* Host hardware abstraction layer
+ * By: John Jekel
+ *
+ * Simulates the parts of the atmega328p the firmware uses, so the firmware logic can be built and
+ * run (and tested) on a workstation. The firmware is unchanged; its avr-libc includes find the
+ * stand-ins in host/include instead, whose registers all go through HAL_access.
+ *
+ * Time is counted in CPU cycles. It advances by HAL_CYCLES_PER_ACCESS on every register access
+ * (a rough stand-in for the code in between) and jumps ahead to the next event when sleeping.
+ * Simulated: interrupts (in priority order), sleep modes (timers and TWI stop in power down),
+ * the TWI master (with models attached as slaves), the internal EEPROM, timers 0 and 2,
+ * the watchdog (interrupt mode), the pins of port D (buttons, INT0 and pin change interrupts), and
+ * SDA and SCL on port C while the TWI is off (for bus recovery).
+ * NOT simulated: timer 1 (the buzzer) beyond its registers, the watchdog's reset mode, the BOD.
+ *
+ * NOTE: The HAL sets reserved bit 1 of TWCR whenever it changes TWCR, so that every write from
+ *  the firmware (which always clears it) can be told apart from a read, even if it writes back
+ *  the value it read. On the real hardware this bit always reads as 0; the firmware ignores it.
+*/
+
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Constants/Macros */
+
+#define HAL_CYCLES_PER_ACCESS 1
+#define HAL_CYCLES_PER_MS (F_CPU / 1000)
+#define HAL_EEPROM_SIZE 1024
+#define HAL_MAX_I2C_DEVICES 4
+#define HAL_MAX_SCHEDULED 8
+
+/* Typedefs */
+
+typedef struct
+{
+    uint8_t address;//7 bit
+    bool (*start)(bool read);//Addressed after a start or repeated start; returns true to ACK
+    bool (*write)(uint8_t byte);//Returns true to ACK
+    uint8_t (*read)();
+    void (*stop)();
+} HAL_i2cDevice_t;
+
+typedef struct//Totals since HAL_reset
+{
+    uint32_t i2cTransactions;//Start bits (repeated starts don't count)
+    uint32_t i2cBytes;//Including address bytes
+    uint32_t eepromReads;
+    uint32_t eepromWrites;
+    uint32_t wakeups;//Sleeps ended by an interrupt
+    uint32_t powerDownWakeups;//The ones that were in power down
+    uint64_t runningCycles;//Cycles not spent sleeping
+    uint64_t awakeCycles;//Cycles not spent in power down (running or idle)
+    uint64_t twiPoweredCycles;//PRTWI clear
+    uint64_t timer1OutputCycles;//PRTIMER1 clear and OC1A toggling (the buzzer)
+    uint64_t pb2LowCycles;//Eg. the LCD module is powered
+} HAL_stats_t;
+
+/* Functions */
+
+//Setup
+void HAL_reset();//Power on reset of the simulated MCU (also detaches devices, watchers and callbacks)
+void HAL_attachI2CDevice(const HAL_i2cDevice_t* device);
+
+//Time
+uint64_t HAL_getCycles();
+void HAL_schedule(uint64_t cycle, void (*callback)());//Runs callback (outside of the firmware's
+                                                      //interrupts) once time reaches cycle
+void HAL_runFor(uint64_t cycles);//Lets time pass outside of the firmware (runs due callbacks/ISRs)
+
+//Pins
+void HAL_setPIND(uint8_t value);//Raises INT0 (PD2) and PCINT2 as configured by the firmware
+uint8_t HAL_getPIND();
+void HAL_watchPIND(void (*watcher)(uint8_t oldValue, uint8_t newValue));//Called on every change
+uint8_t HAL_getPORTB();//Eg. PB2 controls the LCD's power
+void HAL_holdSDA(uint8_t clocks);//A stuck slave holds SDA low (so the TWI can't send a start bit)
+                                 //until SCL is clocked by hand that many times
+
+//Registers (without letting time pass, unlike the firmware's accesses)
+uint8_t HAL_peek(uint8_t address);
+
+//Internal EEPROM (initially erased)
+uint8_t* HAL_getEEPROM();
+
+//Statistics
+const HAL_stats_t* HAL_getStats();
+void HAL_clearStats();
+
+//Called by the firmware through the headers in host/include
+volatile uint8_t* HAL_access(uint8_t address);
+void HAL_cli();
+void HAL_sei();
+void HAL_sleep();
+void HAL_wdr();
+
+#endif//HAL_H
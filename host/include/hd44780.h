@@ -0,0 +1,43 @@
+/* HD44780 model
+ * By: John Jekel
+ *
+ * A 16x2 HD44780 character LCD behind a PCF8574 I2C backpack, for the host build's I2C bus.
+ * Backpack pins: P0 = RS, P1 = R/W, P2 = EN, P3 = backlight, P4 to P7 = D4 to D7.
+ * The module is powered while PB2 is low (through a PNP transistor) and doesn't answer otherwise.
+ * Nibbles are latched on the falling edge of EN. Starts in 8 bit mode after power comes on;
+ * the commands the firmware uses (clear, entry mode, display control, function set, CGRAM and
+ * DDRAM addresses) are simulated, and execution times aren't.
+*/
+
+#ifndef HD44780_H
+#define HD44780_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Constants/Macros */
+
+#define HD44780_ADDRESS 0x27
+
+/* Typedefs */
+
+typedef struct//Totals since HD44780_attach
+{
+    uint32_t i2cBytes;//Writes to the PCF8574
+    uint32_t commands;
+    uint32_t characters;//DDRAM writes
+    uint32_t glyphRows;//CGRAM writes
+} HD44780_stats_t;
+
+/* Functions */
+
+void HD44780_attach();//Call after HAL_reset
+void HD44780_getLine(uint8_t line, char string[17]);//Visible characters (0 or 1); null terminated
+const uint8_t* HD44780_getGlyph(uint8_t index);//8 rows of CGRAM
+bool HD44780_isPowered();
+bool HD44780_isDisplayOn();
+bool HD44780_isBacklightOn();
+const HD44780_stats_t* HD44780_getStats();
+void HD44780_clearStats();
+
+#endif//HD44780_H
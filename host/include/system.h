@@ -0,0 +1,48 @@
+/* Simulated system
+ * By: John Jekel
+ *
+ * Runs the whole firmware (main and UI_scheduler) on the host against the HAL with a DS3231, an
+ * HD44780 and buttons attached, under a virtual clock that only advances as fast as the
+ * simulation can go (a simulated day takes well under a second while the MCU sleeps).
+ *
+ * The firmware never returns from main, so it runs as a coroutine: SYSTEM_runUntil switches to it
+ * and it switches back once simulated time reaches the requested cycle, in the middle of whatever
+ * it was doing. Between calls, the buttons may be changed and the models inspected.
+ *
+ * NOTE: The firmware's RAM can't be reset, so SYSTEM_boot may only be called once per process
+ *  (fork to run independent instances).
+*/
+
+#ifndef SYSTEM_H
+#define SYSTEM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Constants/Macros */
+
+//Buttons (their PORTD bits; active low on the pins)
+#define SYSTEM_LEFT     (1 << 0)
+#define SYSTEM_RIGHT    (1 << 1)
+#define SYSTEM_UP       (1 << 4)
+#define SYSTEM_DOWN     (1 << 5)
+#define SYSTEM_ENTER    (1 << 6)
+#define SYSTEM_EXIT     (1 << 7)
+#define SYSTEM_BUTTONS  0b11110011
+
+#define SYSTEM_CYCLES_PER_SECOND ((uint64_t)F_CPU)
+#define SYSTEM_CYCLES_PER_MS ((uint64_t)F_CPU / 1000)
+
+/* Functions */
+
+void SYSTEM_boot(const uint8_t rtcTime[7]);//DS3231 registers 0x0 to 0x6 (or NULL for the default)
+void SYSTEM_runUntil(uint64_t cycle);
+void SYSTEM_runFor(uint64_t cycles);
+
+void SYSTEM_setButtons(uint8_t pushed);//SYSTEM_* bits of the buttons held down (0 for none)
+void SYSTEM_press(uint8_t buttons, uint64_t holdCycles);//Push, hold, then release
+
+bool SYSTEM_isBuzzerOn();//Timer 1 is driving the buzzer pin
+double SYSTEM_getCharge();//uAh used since boot, from the HAL's statistics and power.h's currents
+
+#endif//SYSTEM_H
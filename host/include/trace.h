@@ -0,0 +1,47 @@
+/* Event traces
+ * By: John Jekel
+ *
+ * Records what the outside world did to the firmware during a simulation, so it can be replayed
+ * later without the models deciding anything (see host/replay). A trace is a text file with one
+ * event per line, in order, each starting with the time in microseconds since boot:
+ *
+ *  <us> rtc <19 hex bytes>     The DS3231's registers from now on (recorded whenever they changed)
+ *  <us> int0                   A falling edge on ~INT/SQW (PD2); a 1hz tick or an alarm
+ *  <us> pind <hex>             PIND after a button was pushed or released (PCINT2)
+ *  <us> settings <alarm> <timeout>  SETTINGS_data was changed from outside of the firmware
+ *  <us> end                    The end of the recording
+ *
+ * Lines starting with # are comments. The first event is always the RTC's registers at boot.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Typedefs */
+
+typedef enum {TRACE_RTC, TRACE_INT0, TRACE_PIND, TRACE_SETTINGS, TRACE_END} TRACE_type_t;
+
+typedef struct
+{
+    uint64_t cycle;//When the event happened (recorded in microseconds)
+    TRACE_type_t type;
+    uint8_t data[19];//RTC registers, PIND, or the alarm enable and timeout
+} TRACE_event_t;
+
+/* Functions */
+
+//Recording (after SYSTEM_boot, before running the firmware)
+void TRACE_startRecording(FILE* file);
+void TRACE_recordRTC();//Records the RTC's registers if they changed since they were last recorded
+void TRACE_recordSettings();
+void TRACE_stopRecording();//Records the end; doesn't close the file
+
+//Reading
+bool TRACE_read(FILE* file, TRACE_event_t* event);//False at the end of the file or on a bad line
+const char* TRACE_getTypeName(TRACE_type_t type);
+
+#endif//TRACE_H
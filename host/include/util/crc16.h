@@ -0,0 +1,22 @@
+/* Host util/crc16.h
+ * By: John Jekel
+ *
+ * Same algorithm as avr-libc's (polynomial 0x07, no reflection).
+*/
+
+#ifndef HOST_UTIL_CRC16_H
+#define HOST_UTIL_CRC16_H
+
+#include <stdint.h>
+
+static inline uint8_t _crc8_ccitt_update(uint8_t crc, uint8_t data)
+{
+    crc ^= data;
+    
+    for (uint8_t i = 0; i < 8; ++i)
+        crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1);
+    
+    return crc;
+}
+
+#endif//HOST_UTIL_CRC16_H
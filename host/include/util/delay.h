@@ -0,0 +1,24 @@
+/* Host util/delay.h
+ * By: John Jekel
+ *
+ * Busy-waits in simulated time.
+*/
+
+#ifndef HOST_UTIL_DELAY_H
+#define HOST_UTIL_DELAY_H
+
+#include "hal.h"
+
+#include <stdint.h>
+
+static inline void _delay_us(double us)
+{
+    HAL_runFor((uint64_t)(us * (F_CPU / 1000000.0)));
+}
+
+static inline void _delay_ms(double ms)
+{
+    HAL_runFor((uint64_t)(ms * (F_CPU / 1000.0)));
+}
+
+#endif//HOST_UTIL_DELAY_H
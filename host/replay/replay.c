@@ -0,0 +1,247 @@
+/* Replay
+ * By: John Jekel
+ *
+ * Replays a trace (see trace.h) through the whole firmware (see system.h), with the DS3231 model
+ * frozen so that the RTC's registers and ~INT/SQW only change as the trace says. Counts the I2C
+ * transactions and bytes, EEPROM reads and writes and LCD cells (characters) written in response
+ * to each kind of event (from when it happened until the next event), so that changes to the
+ * display or RTC code get a reproducible before/after traffic diff.
+ *
+ * Usage: replay [-e] trace [report]
+ *  -e      Also print the counts for every event
+ *  report  A report written by a previous run to compare against; fails if anything differs
+ *          (to update it: replay trace > report)
+*/
+
+#include "hal.h"
+#include "ds3231.h"
+#include "hd44780.h"
+#include "system.h"
+#include "trace.h"
+
+#include "settings.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Constants/Macros */
+
+#define INT0_PIN (1 << 2)
+#define REPORT_SIZE 4096
+
+/* Typedefs */
+
+typedef struct
+{
+    uint32_t events;
+    uint32_t i2cTransactions;
+    uint32_t i2cBytes;
+    uint32_t eepromReads;
+    uint32_t eepromWrites;
+    uint32_t lcdCells;
+} counts_t;
+
+/* Static Variables */
+
+static counts_t totals[TRACE_END + 2];//Each event type, then the boot (up to the first event)
+static bool printEvents;
+
+/* Static Function Declarations */
+
+static counts_t takeCounts();
+static void addCounts(counts_t* total, counts_t before, counts_t after);
+static void applyEvent(const TRACE_event_t* event);
+static void writeReport(FILE* file, const char* tracePath);
+static bool compareReport(const char* report, const char* path);
+
+/* Functions */
+
+int main(int argc, char** argv)
+{
+    int option;
+    while ((option = getopt(argc, argv, "e")) != -1)
+    {
+        if (option != 'e')
+        {
+            fprintf(stderr, "Usage: %s [-e] trace [report]\n", argv[0]);
+            return 2;
+        }
+
+        printEvents = true;
+    }
+
+    if (optind >= argc)
+    {
+        fprintf(stderr, "Usage: %s [-e] trace [report]\n", argv[0]);
+        return 2;
+    }
+
+    FILE* trace = fopen(argv[optind], "r");
+    TRACE_event_t event;
+    if (!trace || !TRACE_read(trace, &event) || (event.type != TRACE_RTC))
+    {
+        fprintf(stderr, "%s isn't a trace\n", argv[optind]);
+        return 2;
+    }
+
+    SYSTEM_boot(event.data);
+    DS3231_freeze();
+    memcpy(DS3231_getRegisters(), event.data, sizeof(event.data));
+
+    counts_t* current = &totals[TRACE_END + 1];//Boot
+    ++current->events;
+    counts_t before = takeCounts();
+    TRACE_type_t lastType = TRACE_RTC;
+
+    while (TRACE_read(trace, &event))
+    {
+        SYSTEM_runUntil(event.cycle);
+
+        counts_t after = takeCounts();
+        addCounts(current, before, after);
+        if (printEvents)
+        {
+            printf("%s: %u I2C transactions, %u I2C bytes, %u EEPROM reads, %u EEPROM writes, "
+                   "%u LCD cells\n", (current == &totals[TRACE_END + 1]) ? "boot" :
+                   TRACE_getTypeName(lastType), after.i2cTransactions - before.i2cTransactions,
+                   after.i2cBytes - before.i2cBytes, after.eepromReads - before.eepromReads,
+                   after.eepromWrites - before.eepromWrites, after.lcdCells - before.lcdCells);
+        }
+
+        if (event.type == TRACE_END)
+            break;
+
+        if (printEvents)
+            printf("%llu ", (unsigned long long)(event.cycle / (SYSTEM_CYCLES_PER_SECOND / 1000000)));
+
+        applyEvent(&event);
+        current = &totals[event.type];
+        ++current->events;
+        lastType = event.type;
+        before = after;
+    }
+
+    if (event.type != TRACE_END)
+    {
+        fprintf(stderr, "The trace is cut off or has a bad line\n");
+        return 1;
+    }
+
+    fclose(trace);
+
+    //Print the report, and compare it with the expected one if there is one
+    char report[REPORT_SIZE];
+    FILE* reportFile = fmemopen(report, sizeof(report), "w");
+    const char* traceName = strrchr(argv[optind], '/');
+    writeReport(reportFile, traceName ? (traceName + 1) : argv[optind]);
+    fclose(reportFile);
+
+    fputs(report, stdout);
+
+    if ((optind + 1) < argc)
+        return compareReport(report, argv[optind + 1]) ? 0 : 1;
+
+    return 0;
+}
+
+/* Static Functions */
+
+static counts_t takeCounts()
+{
+    const HAL_stats_t* stats = HAL_getStats();
+    return (counts_t){0, stats->i2cTransactions, stats->i2cBytes, stats->eepromReads,
+                      stats->eepromWrites, HD44780_getStats()->characters};
+}
+
+static void addCounts(counts_t* total, counts_t before, counts_t after)
+{
+    total->i2cTransactions += after.i2cTransactions - before.i2cTransactions;
+    total->i2cBytes += after.i2cBytes - before.i2cBytes;
+    total->eepromReads += after.eepromReads - before.eepromReads;
+    total->eepromWrites += after.eepromWrites - before.eepromWrites;
+    total->lcdCells += after.lcdCells - before.lcdCells;
+}
+
+static void applyEvent(const TRACE_event_t* event)
+{
+    uint8_t pind = HAL_getPIND();
+
+    switch (event->type)
+    {
+        case TRACE_RTC:
+        {
+            memcpy(DS3231_getRegisters(), event->data, sizeof(event->data));
+            break;
+        }
+        case TRACE_INT0://A pulse is enough; only the falling edge matters to the firmware
+        {
+            HAL_setPIND(pind & ~INT0_PIN);
+            HAL_setPIND(pind | INT0_PIN);
+            break;
+        }
+        case TRACE_PIND://Just the buttons; PD2 belongs to int0 events
+        {
+            HAL_setPIND((event->data[0] & SYSTEM_BUTTONS) | (pind & ~SYSTEM_BUTTONS));
+            break;
+        }
+        case TRACE_SETTINGS:
+        {
+            SETTINGS_data.alarmEnabled = event->data[0];
+            SETTINGS_data.clockTimeout = event->data[1];
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+}
+
+static void writeReport(FILE* file, const char* traceName)
+{
+    fprintf(file, "# Replay of %s: totals for each kind of event (until the next event)\n",
+            traceName);
+    fprintf(file, "%-9s %8s %8s %9s %8s %8s %9s\n", "event", "count", "i2c_txns", "i2c_bytes",
+            "ee_reads", "ee_write", "lcd_cells");
+
+    counts_t sum = {0};
+    for (uint8_t i = 0; i < (TRACE_END + 2); ++i)
+    {
+        if ((i == TRACE_END) || !totals[i].events)
+            continue;
+
+        const counts_t* total = &totals[i];
+        fprintf(file, "%-9s %8u %8u %9u %8u %8u %9u\n",
+                (i == (TRACE_END + 1)) ? "boot" : TRACE_getTypeName(i), total->events,
+                total->i2cTransactions, total->i2cBytes, total->eepromReads, total->eepromWrites,
+                total->lcdCells);
+
+        sum.events += total->events;
+        addCounts(&sum, (counts_t){0}, *total);
+    }
+
+    fprintf(file, "%-9s %8u %8u %9u %8u %8u %9u\n", "total", sum.events, sum.i2cTransactions,
+            sum.i2cBytes, sum.eepromReads, sum.eepromWrites, sum.lcdCells);
+}
+
+static bool compareReport(const char* report, const char* path)
+{
+    FILE* file = fopen(path, "r");
+    char expected[REPORT_SIZE] = "";
+    if (file)
+    {
+        size_t length = fread(expected, 1, sizeof(expected) - 1, file);
+        expected[length] = '\0';
+        fclose(file);
+    }
+
+    if (!strcmp(report, expected))
+        return true;
+
+    printf("DIFFERENT from %s, which expected:\n%s", path, expected);
+    return false;
+}
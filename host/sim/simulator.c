@@ -0,0 +1,545 @@
+/* Simulator
+ * By: John Jekel
+ *
+ * Runs the whole firmware (see system.h) under a virtual clock that goes as fast as the host can
+ * simulate it (a year of SLEEP takes seconds), following a script of button presses, waits and
+ * checks read from a file (or stdin). The 2x16 display, backlight and buzzer are rendered in the
+ * terminal on "show", or whenever they change with -w (watch). Exits with 1 if an "expect" fails.
+ *
+ * Usage: simulator [-w] [-x speed] [-r trace] [script]
+ *  -w          Watch: render the display every time it changes (checked every 100ms)
+ *  -x speed    With -w, run at speed times real time instead of as fast as possible
+ *  -r trace    Record the RTC and button events to a trace file (see trace.h)
+ *
+ * Script commands (one per line; # starts a comment; durations are a number followed by
+ * ms, s, m, h, d or y (365 days)):
+ *  start YYYY-MM-DD HH:MM:SS   Sets the RTC before booting (only before any other command)
+ *  timeout N                   Sets the clock timeout setting (like the menu would)
+ *  alarm HH:MM                 Sets alarm 2 and enables the alarm (or "alarm off")
+ *  wait DURATION               Lets simulated time pass
+ *  press BUTTONS [DURATION]    Pushes, holds (default 100ms), then releases; eg. press UP+DOWN
+ *  hold BUTTONS / release      Pushes buttons down / lets go of all of them
+ *  show                        Renders the display
+ *  stats                       Prints the simulated time and the hardware statistics
+ *  expect 0|1 TEXT             Fails unless the text is in line 0 or 1 of the display
+ *  expect on|off               Fails unless the display is on/off
+ *  expect buzzer|quiet         Fails unless the buzzer is on/off
+ *  expect date YYYY-MM-DD      Fails unless the RTC is at this date
+ *  repeat N / end              Runs the commands in between N times (may be nested)
+ *
+ * CGRAM characters (the custom glyphs) are rendered as '#'.
+*/
+
+#define _DEFAULT_SOURCE//For usleep
+
+#include "hal.h"
+#include "ds3231.h"
+#include "hd44780.h"
+#include "system.h"
+#include "trace.h"
+
+#include "settings.h"
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Constants/Macros */
+
+#define SECOND SYSTEM_CYCLES_PER_SECOND
+#define MS SYSTEM_CYCLES_PER_MS
+
+#define DEFAULT_HOLD (100 * MS)
+#define WATCH_STEP (100 * MS)
+#define SCREEN_SIZE 256
+#define MAX_SCRIPT_LINES 1024
+#define MAX_LINE_LENGTH 256
+#define MAX_REPEAT_DEPTH 8
+
+#define toBCD(value) ((uint8_t)((((value) / 10) << 4) | ((value) % 10)))
+#define fromBCD(value) ((((value) >> 4) * 10) + ((value) & 0x0F))
+
+/* Static Variables */
+
+static bool watch;
+static double speed;//0 for as fast as possible
+static FILE* traceFile;
+static char lastScreen[SCREEN_SIZE];
+
+static bool booted;
+static uint8_t startTime[7] = {0x00, 0x00, 0x00, 0x06, 0x01, 0x01, 0x00};//2000-01-01 (Saturday)
+
+static const char* const buttonNames[] = {"LEFT", "RIGHT", "", "", "UP", "DOWN", "ENTER", "EXIT"};
+
+/* Static Function Declarations */
+
+static bool runCommand(char* command, char* arguments);
+static void boot();
+static void run(uint64_t cycles);
+static void render(char screen[SCREEN_SIZE]);
+static void show();
+static void printStats();
+static bool parseDuration(const char* string, uint64_t* cycles);
+static bool parseButtons(char* string, uint8_t* buttons);
+static bool setStartTime(const char* arguments);
+static void getDate(char date[11]);
+static uint8_t dayOfWeek(unsigned year, unsigned month, unsigned day);
+
+/* Functions */
+
+int main(int argc, char** argv)
+{
+    int option;
+    while ((option = getopt(argc, argv, "wx:r:")) != -1)
+    {
+        switch (option)
+        {
+            case 'w':
+                watch = true;
+                break;
+            case 'x':
+                speed = atof(optarg);
+                break;
+            case 'r':
+                traceFile = fopen(optarg, "w");
+                if (!traceFile)
+                {
+                    fprintf(stderr, "Can't create %s\n", optarg);
+                    return 2;
+                }
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-w] [-x speed] [-r trace] [script]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    FILE* script = stdin;
+    if (optind < argc)
+    {
+        script = fopen(argv[optind], "r");
+        if (!script)
+        {
+            fprintf(stderr, "Can't open %s\n", argv[optind]);
+            return 2;
+        }
+    }
+
+    static char lines[MAX_SCRIPT_LINES][MAX_LINE_LENGTH];
+    unsigned lineCount = 0;
+    while ((lineCount < MAX_SCRIPT_LINES) && fgets(lines[lineCount], MAX_LINE_LENGTH, script))
+        ++lineCount;
+
+    struct {unsigned firstLine; unsigned remaining;} repeats[MAX_REPEAT_DEPTH];
+    uint8_t repeatDepth = 0;
+
+    for (unsigned lineNumber = 0; lineNumber < lineCount; ++lineNumber)
+    {
+        char line[MAX_LINE_LENGTH];
+        strcpy(line, lines[lineNumber]);//strtok modifies it, and it may be run again
+
+        char* comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+        line[strcspn(line, "\r\n")] = '\0';
+
+        char* command = strtok(line, " \t");
+        if (!command)
+            continue;//Blank line
+
+        char* arguments = strtok(NULL, "");
+        while (arguments && isspace((unsigned char)*arguments))
+            ++arguments;
+
+        bool succeeded = true;
+        if (!strcmp(command, "repeat"))
+        {
+            int count = arguments ? atoi(arguments) : 0;
+            succeeded = (count > 0) && (repeatDepth < MAX_REPEAT_DEPTH);
+            if (succeeded)
+            {
+                repeats[repeatDepth].firstLine = lineNumber + 1;
+                repeats[repeatDepth].remaining = count - 1;
+                ++repeatDepth;
+            }
+        }
+        else if (!strcmp(command, "end"))
+        {
+            succeeded = repeatDepth != 0;
+            if (succeeded && repeats[repeatDepth - 1].remaining)
+            {
+                --repeats[repeatDepth - 1].remaining;
+                lineNumber = repeats[repeatDepth - 1].firstLine - 1;//Back to the start
+            }
+            else if (succeeded)
+                --repeatDepth;
+        }
+        else
+            succeeded = runCommand(command, arguments ? arguments : "");
+
+        if (!succeeded)
+        {
+            fprintf(stderr, "Line %u failed\n", lineNumber + 1);
+            show();
+            TRACE_stopRecording();
+            return 1;
+        }
+    }
+
+    TRACE_stopRecording();
+    return 0;
+}
+
+/* Static Functions */
+
+static bool runCommand(char* command, char* arguments)
+{
+    if (!strcmp(command, "start"))
+    {
+        if (booted)
+        {
+            fprintf(stderr, "start must come before any other command\n");
+            return false;
+        }
+
+        return setStartTime(arguments);
+    }
+
+    boot();//Once the start time is known
+
+    if (!strcmp(command, "timeout"))
+    {
+        int timeout = atoi(arguments);
+        if ((timeout < 1) || (timeout > 99))
+        {
+            fprintf(stderr, "The timeout must be 1 to 99\n");
+            return false;
+        }
+
+        SETTINGS_data.clockTimeout = timeout;
+        TRACE_recordSettings();
+        return true;
+    }
+    else if (!strcmp(command, "alarm"))
+    {
+        unsigned hours, minutes;
+        if (!strcmp(arguments, "off"))
+        {
+            SETTINGS_data.alarmEnabled = false;
+            TRACE_recordSettings();
+            return true;
+        }
+        else if ((sscanf(arguments, "%u:%u", &hours, &minutes) != 2) || (hours > 23) ||
+                 (minutes > 59))
+        {
+            fprintf(stderr, "Expected HH:MM or off\n");
+            return false;
+        }
+
+        uint8_t* rtc = DS3231_getRegisters();
+        rtc[0xB] = toBCD(minutes);
+        rtc[0xC] = toBCD(hours);
+        SETTINGS_data.alarmEnabled = true;
+        TRACE_recordRTC();
+        TRACE_recordSettings();
+        return true;
+    }
+    else if (!strcmp(command, "wait"))
+    {
+        uint64_t cycles;
+        if (!parseDuration(arguments, &cycles))
+            return false;
+
+        run(cycles);
+        return true;
+    }
+    else if (!strcmp(command, "press") || !strcmp(command, "hold"))
+    {
+        char* buttonString = strtok(arguments, " \t");
+        char* durationString = strtok(NULL, " \t");
+        uint8_t buttons;
+        uint64_t hold = DEFAULT_HOLD;
+
+        if (!parseButtons(buttonString, &buttons) ||
+            (durationString && !parseDuration(durationString, &hold)))
+            return false;
+
+        SYSTEM_setButtons(buttons);
+        if (command[0] == 'p')
+        {
+            run(hold);
+            SYSTEM_setButtons(0);
+        }
+        return true;
+    }
+    else if (!strcmp(command, "release"))
+    {
+        SYSTEM_setButtons(0);
+        return true;
+    }
+    else if (!strcmp(command, "show"))
+    {
+        show();
+        return true;
+    }
+    else if (!strcmp(command, "stats"))
+    {
+        printStats();
+        return true;
+    }
+    else if (!strcmp(command, "expect"))
+    {
+        char* what = strtok(arguments, " \t");
+        char* text = strtok(NULL, "");
+        if (!what)
+            what = "";
+
+        if ((!strcmp(what, "0") || !strcmp(what, "1")) && text)
+        {
+            char screen[SCREEN_SIZE];
+            render(screen);
+
+            //The lines are the 2nd and 3rd lines of the rendering, after the border's "|"
+            char* line = strchr(screen, '\n') + 2;
+            if (what[0] == '1')
+                line = strchr(line, '\n') + 2;
+            line[16] = '\0';
+
+            if (!HD44780_isDisplayOn() || !strstr(line, text))
+            {
+                fprintf(stderr, "Expected \"%s\" in line %s\n", text, what);
+                return false;
+            }
+            return true;
+        }
+        else if (!strcmp(what, "on") || !strcmp(what, "off"))
+        {
+            if (HD44780_isDisplayOn() != (what[1] == 'n'))
+            {
+                fprintf(stderr, "Expected the display to be %s\n", what);
+                return false;
+            }
+            return true;
+        }
+        else if (!strcmp(what, "buzzer") || !strcmp(what, "quiet"))
+        {
+            if (SYSTEM_isBuzzerOn() != (what[0] == 'b'))
+            {
+                fprintf(stderr, "Expected the buzzer to be %s\n", (what[0] == 'b') ? "on" : "off");
+                return false;
+            }
+            return true;
+        }
+        else if (!strcmp(what, "date") && text)
+        {
+            char date[11];
+            getDate(date);
+            if (strcmp(date, text))
+            {
+                fprintf(stderr, "Expected the date to be %s, not %s\n", text, date);
+                return false;
+            }
+            return true;
+        }
+
+        fprintf(stderr, "Unknown expectation\n");
+        return false;
+    }
+
+    fprintf(stderr, "Unknown command %s\n", command);
+    return false;
+}
+
+static void boot()
+{
+    if (booted)
+        return;
+
+    booted = true;
+    SYSTEM_boot(startTime);
+    if (traceFile)
+        TRACE_startRecording(traceFile);
+
+    //Get past the splash screen so settings from the script aren't overwritten by SETTINGS_load
+    run(1 * SECOND);
+}
+
+static void run(uint64_t cycles)
+{
+    uint64_t end = HAL_getCycles() + cycles;
+
+    if (!watch)
+    {
+        SYSTEM_runUntil(end);
+        return;
+    }
+
+    while (HAL_getCycles() < end)
+    {
+        uint64_t step = end - HAL_getCycles();
+        if (step > WATCH_STEP)
+            step = WATCH_STEP;
+
+        SYSTEM_runFor(step);
+
+        char screen[SCREEN_SIZE];
+        render(screen);
+        if (strcmp(screen, lastScreen))
+        {
+            printf("\x1b[H\x1b[2J%s", screen);//Home and clear, then redraw
+            fflush(stdout);
+            strcpy(lastScreen, screen);
+        }
+
+        if (speed > 0)
+            usleep((useconds_t)(step * 1000000 / SECOND / speed));
+    }
+}
+
+static void render(char screen[SCREEN_SIZE])
+{
+    char lines[2][17];
+    for (uint8_t i = 0; i < 2; ++i)
+    {
+        if (HD44780_isPowered() && HD44780_isDisplayOn())
+        {
+            HD44780_getLine(i, lines[i]);
+            for (uint8_t j = 0; j < 16; ++j)
+            {
+                if ((uint8_t)lines[i][j] < 0x10)
+                    lines[i][j] = '#';//CGRAM
+                else if (!isprint((unsigned char)lines[i][j]))
+                    lines[i][j] = '?';
+            }
+        }
+        else
+            memset(lines[i], ' ', 16);
+
+        lines[i][16] = '\0';
+    }
+
+    const uint8_t* rtc = DS3231_getRegisters();
+    char date[11];
+    getDate(date);
+
+    snprintf(screen, SCREEN_SIZE,
+             "+----------------+  %s %02x:%02x:%02x\n"
+             "|%s|  backlight %s\n"
+             "|%s|  buzzer %s\n"
+             "+----------------+\n",
+             date, rtc[0x2], rtc[0x1], rtc[0x0],
+             lines[0], HD44780_isBacklightOn() ? "on" : "off",
+             lines[1], SYSTEM_isBuzzerOn() ? "on" : "off");
+}
+
+static void show()
+{
+    char screen[SCREEN_SIZE];
+    render(screen);
+    fputs(screen, stdout);
+    fflush(stdout);
+}
+
+static void printStats()
+{
+    const HAL_stats_t* stats = HAL_getStats();
+    printf("Simulated time: %.3fs\n", (double)HAL_getCycles() / SECOND);
+    printf("I2C transactions: %u\n", stats->i2cTransactions);
+    printf("I2C bytes: %u\n", stats->i2cBytes);
+    printf("EEPROM reads: %u\n", stats->eepromReads);
+    printf("EEPROM writes: %u\n", stats->eepromWrites);
+    printf("Wakeups: %u (%u from power down)\n", stats->wakeups, stats->powerDownWakeups);
+    printf("Awake cycles: %llu (%llu running)\n", (unsigned long long)stats->awakeCycles,
+           (unsigned long long)stats->runningCycles);
+    fflush(stdout);
+}
+
+static bool parseDuration(const char* string, uint64_t* cycles)
+{
+    static const struct {const char* suffix; uint64_t cycles;} units[] =
+    {
+        {"ms", MS}, {"s", SECOND}, {"m", 60 * SECOND}, {"h", 3600 * SECOND},
+        {"d", 86400 * SECOND}, {"y", 365 * 86400 * SECOND}
+    };
+
+    char* suffix;
+    double amount = strtod(string, &suffix);
+
+    for (uint8_t i = 0; i < sizeof(units) / sizeof(units[0]); ++i)
+    {
+        if (!strcmp(suffix, units[i].suffix) && (suffix != string) && (amount >= 0))
+        {
+            *cycles = (uint64_t)(amount * units[i].cycles);
+            return true;
+        }
+    }
+
+    fprintf(stderr, "Bad duration \"%s\"\n", string);
+    return false;
+}
+
+static bool parseButtons(char* string, uint8_t* buttons)//Eg. UP+DOWN
+{
+    *buttons = 0;
+
+    for (char* name = strtok(string, "+"); name; name = strtok(NULL, "+"))
+    {
+        uint8_t bit = 0;
+        while ((bit < 8) && (!buttonNames[bit][0] || strcmp(name, buttonNames[bit])))
+            ++bit;
+
+        if (bit == 8)
+        {
+            fprintf(stderr, "Unknown button %s\n", name);
+            return false;
+        }
+
+        *buttons |= 1 << bit;
+    }
+
+    return *buttons != 0;
+}
+
+static bool setStartTime(const char* arguments)
+{
+    unsigned year, month, day, hours, minutes, seconds;
+    if ((sscanf(arguments, "%u-%u-%u %u:%u:%u", &year, &month, &day, &hours, &minutes,
+                &seconds) != 6) || (year < 2000) || (year > 2199) || !month || (month > 12) ||
+        !day || (day > 31) || (hours > 23) || (minutes > 59) || (seconds > 59))
+    {
+        fprintf(stderr, "Expected YYYY-MM-DD HH:MM:SS between 2000 and 2199\n");
+        return false;
+    }
+
+    startTime[0x0] = toBCD(seconds);
+    startTime[0x1] = toBCD(minutes);
+    startTime[0x2] = toBCD(hours);
+    startTime[0x3] = dayOfWeek(year, month, day);
+    startTime[0x4] = toBCD(day);
+    startTime[0x5] = toBCD(month) | ((year >= 2100) ? 0x80 : 0x00);//Century bit
+    startTime[0x6] = toBCD(year % 100);
+    return true;
+}
+
+static void getDate(char date[11])
+{
+    const uint8_t* rtc = DS3231_getRegisters();
+    unsigned year = ((rtc[0x5] & 0x80) ? 2100 : 2000) + fromBCD(rtc[0x6]);
+    snprintf(date, 11, "%04u-%02u-%02u", year % 10000, fromBCD(rtc[0x5] & 0x1F) % 100,
+             fromBCD(rtc[0x4]) % 100);
+}
+
+static uint8_t dayOfWeek(unsigned year, unsigned month, unsigned day)//1 is Monday, 7 is Sunday
+{
+    //Sakamoto's method (0 is Sunday)
+    static const uint8_t offsets[12] = {0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4};
+    if (month < 3)
+        --year;
+
+    uint8_t day0 = (year + (year / 4) - (year / 100) + (year / 400) + offsets[month - 1] + day) % 7;
+    return day0 ? day0 : 7;
+}
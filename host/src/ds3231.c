@@ -0,0 +1,254 @@
+/* DS3231 model
+ * By: John Jekel
+ *
+ * See ds3231.h. The countdown chain runs off of HAL_schedule every half second (the 1hz square
+ * wave falls when the seconds register updates and rises half way through the second).
+*/
+
+#include "ds3231.h"
+#include "hal.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Constants/Macros */
+
+#define HALF_SECOND_CYCLES (F_CPU / 2)
+
+#define CONTROL 0x0E
+#define STATUS 0x0F
+
+/* Static Variables */
+
+static uint8_t registers[19];
+static uint8_t pointer;
+static bool pointerNext;//The first byte written after the address sets the pointer
+static bool squareWaveHigh;
+static uint64_t nextHalfSecondAt;
+static uint32_t secondsElapsed;
+static bool frozen;
+
+/* Static Function Declarations */
+
+static bool start(bool read);
+static bool write(uint8_t byte);
+static uint8_t read();
+
+static void halfSecond();
+static void tick();
+static bool incrementBCD(uint8_t* value, uint8_t max, uint8_t min);
+static bool alarmMatches(uint8_t first, uint8_t count);
+static void updatePin();
+
+//How the bus sees the functions above
+static const HAL_i2cDevice_t device = {DS3231_ADDRESS, start, write, read, NULL};
+
+/* Functions */
+
+void DS3231_attach()
+{
+    memset(registers, 0, sizeof(registers));
+    registers[0x3] = 0x07;//Saturday
+    registers[0x4] = 0x01;
+    registers[0x5] = 0x01;
+    registers[CONTROL] = 0b00011100;//Power on defaults: INTCN set, 8khz rate bits, no alarms
+    registers[STATUS] = 0b10001000;//OSF and EN32kHz
+    registers[0x11] = 25;//25.00 degrees
+
+    pointer = 0;
+    pointerNext = false;
+    squareWaveHigh = true;
+    secondsElapsed = 0;
+    frozen = false;
+
+    HAL_attachI2CDevice(&device);
+
+    nextHalfSecondAt = HAL_getCycles() + HALF_SECOND_CYCLES;
+    HAL_schedule(nextHalfSecondAt, halfSecond);
+    updatePin();
+}
+
+uint8_t* DS3231_getRegisters()
+{
+    return registers;
+}
+
+uint32_t DS3231_getSecondsElapsed()
+{
+    return secondsElapsed;
+}
+
+void DS3231_freeze()
+{
+    frozen = true;
+}
+
+/* Static Functions */
+
+//I2C
+
+static bool start(bool read)
+{
+    pointerNext = !read;
+    return true;
+}
+
+static bool write(uint8_t byte)
+{
+    if (pointerNext)
+    {
+        pointer = byte % sizeof(registers);
+        pointerNext = false;
+        return true;
+    }
+
+    switch (pointer)
+    {
+        case 0x0://Writing the seconds resets the countdown chain
+        {
+            registers[0x0] = byte;
+            squareWaveHigh = true;
+            nextHalfSecondAt = HAL_getCycles() + HALF_SECOND_CYCLES;
+            HAL_schedule(nextHalfSecondAt, halfSecond);//The old callback is ignored when it runs
+            break;
+        }
+        case STATUS://A1F and A2F can only be cleared; OSF is cleared by writing 0 too
+        {
+            registers[STATUS] = (registers[STATUS] & (byte | 0b01110100)) | (byte & 0b00001000);
+            break;
+        }
+        case 0x11:
+        case 0x12://Temperature is read only
+        {
+            break;
+        }
+        default:
+        {
+            registers[pointer] = byte;
+            break;
+        }
+    }
+
+    pointer = (pointer + 1) % sizeof(registers);
+    updatePin();
+    return true;
+}
+
+static uint8_t read()
+{
+    uint8_t byte = registers[pointer];
+    pointer = (pointer + 1) % sizeof(registers);
+    return byte;
+}
+
+//Timekeeping
+
+static void halfSecond()
+{
+    if (frozen || (HAL_getCycles() != nextHalfSecondAt))
+        return;//Stopped, or stale (the countdown chain was reset)
+
+    nextHalfSecondAt += HALF_SECOND_CYCLES;
+    HAL_schedule(nextHalfSecondAt, halfSecond);
+
+    squareWaveHigh = !squareWaveHigh;
+    if (!squareWaveHigh)//The falling edge is when the seconds register updates
+        tick();
+
+    updatePin();
+}
+
+static void tick()
+{
+    ++secondsElapsed;
+
+    if (incrementBCD(&registers[0x0], 0x59, 0x00) &&
+        incrementBCD(&registers[0x1], 0x59, 0x00) &&
+        incrementBCD(&registers[0x2], 0x23, 0x00))
+    {
+        incrementBCD(&registers[0x3], 0x07, 0x01);
+
+        static const uint8_t daysInMonth[12] =
+            {0x31, 0x28, 0x31, 0x30, 0x31, 0x30, 0x31, 0x31, 0x30, 0x31, 0x30, 0x31};
+        uint8_t month = (((registers[0x5] >> 4) & 0x01) * 10) + (registers[0x5] & 0x0F);
+        uint8_t year = ((registers[0x6] >> 4) * 10) + (registers[0x6] & 0x0F);
+        uint8_t lastDay = ((month == 2) && !(year % 4)) ? 0x29 : daysInMonth[(month - 1) % 12];
+
+        if (incrementBCD(&registers[0x4], lastDay, 0x01))
+        {
+            uint8_t century = registers[0x5] & 0x80;
+            registers[0x5] &= 0x1F;
+
+            if (incrementBCD(&registers[0x5], 0x12, 0x01) &&
+                incrementBCD(&registers[0x6], 0x99, 0x00))
+                century ^= 0x80;
+
+            registers[0x5] |= century;
+        }
+    }
+
+    if (alarmMatches(0x7, 4))
+        registers[STATUS] |= 1 << 0;//A1F
+    if ((registers[0x0] == 0x00) && alarmMatches(0xB, 3))//Alarm 2 has no seconds
+        registers[STATUS] |= 1 << 1;//A2F
+}
+
+static bool incrementBCD(uint8_t* value, uint8_t max, uint8_t min)//Returns true on rollover
+{
+    if (*value >= max)
+    {
+        *value = min;
+        return true;
+    }
+
+    if ((*value & 0x0F) == 9)
+        *value += 0x07;
+    else
+        ++*value;
+
+    return false;
+}
+
+static bool alarmMatches(uint8_t first, uint8_t count)
+{
+    //Each alarm register is compared with the time register it lines up with unless its mask
+    //bit (bit 7) is set; the day/date register's DY/DT bit isn't simulated (date only)
+    uint8_t timeRegister = (count == 4) ? 0x0 : 0x1;
+
+    for (uint8_t i = 0; i < count; ++i, ++timeRegister)
+    {
+        uint8_t alarm = registers[first + i];
+
+        if (alarm & 0x80)
+            continue;
+
+        uint8_t now = registers[(timeRegister == 0x3) ? 0x4 : timeRegister];
+        uint8_t bits = (timeRegister >= 0x2) ? 0x3F : 0x7F;//Hours: bit 6 is 12/24; date: bit 6 is DY/DT
+        if ((alarm & bits) != (now & bits))
+            return false;
+    }
+
+    return true;
+}
+
+static void updatePin()
+{
+    if (frozen)
+        return;
+
+    bool high;
+
+    if (registers[CONTROL] & (1 << 2))//INTCN: the pin is the (active low) alarm interrupt
+    {
+        uint8_t fired = registers[STATUS] & registers[CONTROL] & 0b11;
+        high = !fired;
+    }
+    else//1hz square wave (other rates aren't simulated)
+        high = squareWaveHigh;
+
+    uint8_t pind = HAL_getPIND();
+    uint8_t newPIND = high ? (pind | (1 << 2)) : (pind & ~(1 << 2));
+    if (newPIND != pind)
+        HAL_setPIND(newPIND);
+}
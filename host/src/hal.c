@@ -0,0 +1,902 @@
+/* Host hardware abstraction layer
+ * By: John Jekel
+ *
+ * See hal.h. Everything happens in HAL_access (and the other entry points the firmware calls):
+ * time moves forward, the peripheral models react to what the firmware wrote since the last
+ * access, and any pending interrupt whose ISR can run is called.
+*/
+
+#include "hal.h"
+
+#include <avr/interrupt.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Constants/Macros */
+
+#define NEVER UINT64_MAX
+
+//Register addresses (see host/include/avr/io.h)
+#define R_PINC      0x26
+#define R_DDRC      0x27
+#define R_PORTC     0x28
+#define R_PIND      0x29
+#define R_PORTB     0x25
+#define R_TIFR0     0x35
+#define R_TIFR2     0x37
+#define R_PCIFR     0x3B
+#define R_EIFR      0x3C
+#define R_EIMSK     0x3D
+#define R_EECR      0x3F
+#define R_EEDR      0x40
+#define R_EEARL     0x41
+#define R_EEARH     0x42
+#define R_GTCCR     0x43
+#define R_TCCR0A    0x44
+#define R_TCCR0B    0x45
+#define R_TCNT0     0x46
+#define R_SMCR      0x53
+#define R_SREG      0x5F
+#define R_WDTCSR    0x60
+#define R_PRR       0x64
+#define R_PCICR     0x68
+#define R_EICRA     0x69
+#define R_PCMSK2    0x6D
+#define R_TCCR1A    0x80
+#define R_TIMSK0    0x6E
+#define R_TIMSK2    0x70
+#define R_TCCR2A    0xB0
+#define R_TCCR2B    0xB1
+#define R_TCNT2     0xB2
+#define R_OCR2A     0xB3
+#define R_TWBR      0xB8
+#define R_TWSR      0xB9
+#define R_TWDR      0xBB
+#define R_TWCR      0xBC
+
+#define TWCR_MARKER 0b00000010//Reserved bit; see hal.h
+#define SDA_PIN (1 << 4)//Port C
+#define SCL_PIN (1 << 5)
+
+#define EEPROM_WRITE_CYCLES ((F_CPU / 10000) * 34)//3.4ms
+#define WDT_BASE_CYCLES ((F_CPU / 1000) * 16)//16ms at the nominal 128khz
+
+/* Typedefs */
+
+typedef enum {AWAKE, IDLE, POWER_DOWN} sleepState_t;
+typedef enum {BUS_FREE, ADDRESS_NEXT, WRITING, READING} busState_t;
+
+typedef struct
+{
+    uint8_t tccrB, tcnt, tifr, timsk;//Register addresses
+    uint8_t flagBit;//Compare match A (CTC) or overflow (normal mode)
+    uint8_t prrBit;
+    const uint16_t* prescalers;//By CS bits
+    uint64_t prescalerCount;//Cycles since the last tick
+} hardwareTimer_t;
+
+/* Static Variables */
+
+static uint8_t io[256];
+static uint8_t shadow[256];//What io held after the last time the models looked at it
+
+static uint64_t cycles;
+static sleepState_t sleepState;
+static HAL_stats_t stats;
+
+static struct
+{
+    uint64_t cycle;
+    void (*callback)();
+} scheduled[HAL_MAX_SCHEDULED];
+static uint8_t scheduledCount;
+
+//TWI
+static const HAL_i2cDevice_t* devices[HAL_MAX_I2C_DEVICES];
+static uint8_t deviceCount;
+static const HAL_i2cDevice_t* addressed;
+static busState_t busState;
+static uint8_t sdaHeldClocks;//SCL clocks until a stuck slave lets go of SDA (0 if none is stuck)
+static struct
+{
+    bool active;
+    uint64_t doneAt;
+    uint8_t status;//TWSR bits 7:3
+    bool isStop;
+    bool hasData;
+    uint8_t data;//Read into TWDR when done
+} twiOperation;
+
+//Pins
+static void (*pindWatcher)(uint8_t oldValue, uint8_t newValue);
+
+//EEPROM
+static uint8_t eeprom[HAL_EEPROM_SIZE];
+static uint64_t eepromDoneAt = NEVER;
+
+//Watchdog
+static uint64_t wdtPeriod;//0 if stopped
+static uint64_t wdtNextAt = NEVER;
+static bool wdtChangeEnabled;
+
+//Timers
+static const uint16_t timer0Prescalers[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+static const uint16_t timer2Prescalers[8] = {0, 1, 8, 32, 64, 128, 256, 1024};
+static hardwareTimer_t timer0 = {R_TCCR0B, R_TCNT0, R_TIFR0, R_TIMSK0, 0, 5, timer0Prescalers, 0};
+static hardwareTimer_t timer2 = {R_TCCR2B, R_TCNT2, R_TIFR2, R_TIMSK2, 1, 6, timer2Prescalers, 0};
+
+/* Static Function Declarations */
+
+static void fatal(const char* message);
+static void sync();
+static void advanceTo(uint64_t target);
+static void advanceHardware(uint64_t target);
+static uint64_t nextEventTime();
+static void detectWrites();
+static void dispatchPending();
+static void runISR(void (*isr)(void));
+static void (*pendingISR(bool wakeSourcesOnly))(void);
+
+static void setTWCR(uint8_t value);
+static void updatePINC();
+static void twiCommand(uint8_t command);
+static void twiBeginOperation(uint8_t status, uint8_t bytes);
+static uint64_t sclPeriod();
+
+static void eepromControl(uint8_t oldValue, uint8_t newValue);
+static void wdtControl(uint8_t newValue);
+
+static bool timerRunning(const hardwareTimer_t* timer);
+static uint8_t timerTop(const hardwareTimer_t* timer);
+static void advanceTimer(hardwareTimer_t* timer, uint64_t elapsed);
+static uint64_t timerNextInterrupt(const hardwareTimer_t* timer);
+
+/* Functions */
+
+//Setup
+
+void HAL_reset()
+{
+    memset(io, 0, sizeof(io));
+    io[R_PIND] = 0xFF;//Buttons are pulled up and not pushed; the RTC's ~INT/SQW is high
+    io[R_PINC] = SDA_PIN | SCL_PIN;//The bus is pulled up
+    memcpy(shadow, io, sizeof(io));
+    pindWatcher = NULL;
+
+    cycles = 0;
+    sleepState = AWAKE;
+    scheduledCount = 0;
+    HAL_clearStats();
+
+    deviceCount = 0;
+    addressed = NULL;
+    busState = BUS_FREE;
+    sdaHeldClocks = 0;
+    twiOperation.active = false;
+
+    memset(eeprom, 0xFF, sizeof(eeprom));
+    eepromDoneAt = NEVER;
+
+    wdtPeriod = 0;
+    wdtNextAt = NEVER;
+    wdtChangeEnabled = false;
+
+    timer0.prescalerCount = 0;
+    timer2.prescalerCount = 0;
+}
+
+void HAL_attachI2CDevice(const HAL_i2cDevice_t* device)
+{
+    if (deviceCount == HAL_MAX_I2C_DEVICES)
+        fatal("Too many I2C devices");
+
+    devices[deviceCount] = device;
+    ++deviceCount;
+}
+
+//Time
+
+uint64_t HAL_getCycles()
+{
+    return cycles;
+}
+
+void HAL_schedule(uint64_t cycle, void (*callback)())
+{
+    if (scheduledCount == HAL_MAX_SCHEDULED)
+        fatal("Too many scheduled callbacks");
+
+    scheduled[scheduledCount].cycle = cycle;
+    scheduled[scheduledCount].callback = callback;
+    ++scheduledCount;
+}
+
+void HAL_runFor(uint64_t duration)
+{
+    uint64_t target = cycles + duration;
+
+    while (cycles < target)
+    {
+        uint64_t next = nextEventTime();
+        advanceTo((next < target) ? next : target);
+        detectWrites();
+        dispatchPending();
+    }
+}
+
+//Pins
+
+void HAL_setPIND(uint8_t value)
+{
+    uint8_t oldValue = io[R_PIND];
+    io[R_PIND] = shadow[R_PIND] = value;
+
+    //INT0 is PD2; ISC0[1:0] decides which edges set the flag (low level is checked when pending)
+    bool oldINT0 = (oldValue >> 2) & 1;
+    bool newINT0 = (value >> 2) & 1;
+    switch (io[R_EICRA] & 0b11)
+    {
+        case 0b01://Any change
+        {
+            if (oldINT0 != newINT0)
+                io[R_EIFR] |= 1;
+            break;
+        }
+        case 0b10://Falling edge
+        {
+            if (oldINT0 && !newINT0)
+                io[R_EIFR] |= 1;
+            break;
+        }
+        case 0b11://Rising edge
+        {
+            if (!oldINT0 && newINT0)
+                io[R_EIFR] |= 1;
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+
+    if ((oldValue ^ value) & io[R_PCMSK2])
+        io[R_PCIFR] |= 1 << 2;
+
+    if (pindWatcher && (oldValue != value))
+        pindWatcher(oldValue, value);
+}
+
+void HAL_watchPIND(void (*watcher)(uint8_t oldValue, uint8_t newValue))
+{
+    pindWatcher = watcher;
+}
+
+uint8_t HAL_getPIND()
+{
+    return io[R_PIND];
+}
+
+uint8_t HAL_getPORTB()
+{
+    return io[R_PORTB];
+}
+
+void HAL_holdSDA(uint8_t clocks)
+{
+    sdaHeldClocks = clocks;
+    updatePINC();
+}
+
+//Registers
+
+uint8_t HAL_peek(uint8_t address)
+{
+    return io[address];
+}
+
+//Internal EEPROM
+
+uint8_t* HAL_getEEPROM()
+{
+    return eeprom;
+}
+
+//Statistics
+
+const HAL_stats_t* HAL_getStats()
+{
+    return &stats;
+}
+
+void HAL_clearStats()
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+//Called by the firmware
+
+volatile uint8_t* HAL_access(uint8_t address)
+{
+    sync();
+    return &io[address];
+}
+
+void HAL_cli()
+{
+    sync();
+    io[R_SREG] &= ~0x80;
+    shadow[R_SREG] = io[R_SREG];
+}
+
+void HAL_sei()
+{
+    sync();
+    io[R_SREG] |= 0x80;
+    shadow[R_SREG] = io[R_SREG];
+    //Like the real sei, the next thing (eg. sleep) happens before any pending interrupt fires
+}
+
+void HAL_sleep()
+{
+    detectWrites();//Without advancing time or dispatching anything (see HAL_sei)
+
+    if (!(io[R_SMCR] & 1))
+        return;//SE is clear, so sleep does nothing
+
+    if (!(io[R_SREG] & 0x80))
+        fatal("Slept with interrupts disabled");
+
+    uint8_t mode = (io[R_SMCR] >> 1) & 0b111;
+    sleepState = (mode == 0b000) ? IDLE : POWER_DOWN;//Power save etc. act like power down here
+
+    void (*isr)(void);
+    while (!(isr = pendingISR(true)))
+    {
+        uint64_t next = nextEventTime();
+        if (next == NEVER)
+            fatal("Sleeping forever (nothing can wake the MCU)");
+
+        advanceTo(next);
+        detectWrites();
+    }
+
+    if (sleepState == POWER_DOWN)
+        ++stats.powerDownWakeups;
+    sleepState = AWAKE;
+    ++stats.wakeups;
+    runISR(isr);
+    dispatchPending();
+}
+
+void HAL_wdr()
+{
+    sync();
+
+    if (wdtPeriod)
+        wdtNextAt = cycles + wdtPeriod;
+}
+
+/* Static Functions */
+
+static void fatal(const char* message)
+{
+    fprintf(stderr, "HAL: %s (at cycle %llu)\n", message, (unsigned long long)cycles);
+    abort();
+}
+
+static void sync()
+{
+    advanceTo(cycles + HAL_CYCLES_PER_ACCESS);
+    detectWrites();
+    dispatchPending();
+}
+
+static void advanceTo(uint64_t target)//Also runs scheduled callbacks that come due
+{
+    while (true)
+    {
+        //Find the earliest callback due by the target
+        uint8_t earliest = scheduledCount;
+        for (uint8_t i = 0; i < scheduledCount; ++i)
+        {
+            if ((scheduled[i].cycle <= target) &&
+                ((earliest == scheduledCount) || (scheduled[i].cycle < scheduled[earliest].cycle)))
+                earliest = i;
+        }
+
+        if (earliest == scheduledCount)
+            break;
+
+        void (*callback)() = scheduled[earliest].callback;
+        if (scheduled[earliest].cycle > cycles)
+            advanceHardware(scheduled[earliest].cycle);
+
+        --scheduledCount;
+        scheduled[earliest] = scheduled[scheduledCount];
+        callback();//May schedule more
+    }
+
+    if (target > cycles)
+        advanceHardware(target);
+}
+
+static void advanceHardware(uint64_t target)
+{
+    uint64_t elapsed = target - cycles;
+    bool clockRunning = sleepState != POWER_DOWN;
+
+    if (sleepState == AWAKE)
+        stats.runningCycles += elapsed;
+    if (clockRunning)
+        stats.awakeCycles += elapsed;
+    if (!(io[R_PRR] & (1 << 7)))
+        stats.twiPoweredCycles += elapsed;
+    if (!(io[R_PRR] & (1 << 3)) && (io[R_TCCR1A] & (1 << 6)))
+        stats.timer1OutputCycles += elapsed;
+    if (!(io[R_PORTB] & (1 << 2)))
+        stats.pb2LowCycles += elapsed;
+
+    //TWI (stops with the CPU clock or when disabled in PRR)
+    if (twiOperation.active)
+    {
+        if (!clockRunning || (io[R_PRR] & (1 << 7)))
+            twiOperation.doneAt += elapsed;
+        else if (twiOperation.doneAt <= target)
+        {
+            twiOperation.active = false;
+
+            if (twiOperation.isStop)
+                setTWCR(io[R_TWCR] & ~(1 << 4));//TWSTO clears once the stop bit is sent
+            else
+            {
+                if (twiOperation.hasData)
+                    io[R_TWDR] = shadow[R_TWDR] = twiOperation.data;
+
+                io[R_TWSR] = (twiOperation.status & 0xF8) | (io[R_TWSR] & 0b11);
+                shadow[R_TWSR] = io[R_TWSR];
+                setTWCR(io[R_TWCR] | (1 << 7));//Set TWINT
+            }
+        }
+    }
+
+    //Timers (also stop with the CPU clock)
+    if (clockRunning)
+    {
+        advanceTimer(&timer0, elapsed);
+        advanceTimer(&timer2, elapsed);
+    }
+
+    //EEPROM writes finish on their own
+    if (eepromDoneAt <= target)
+    {
+        eepromDoneAt = NEVER;
+        io[R_EECR] &= ~(1 << 1);//Clear EEPE
+        shadow[R_EECR] = io[R_EECR];
+    }
+
+    //Watchdog (has its own oscillator)
+    while (wdtNextAt <= target)
+    {
+        io[R_WDTCSR] |= 1 << 7;//Set WDIF
+        shadow[R_WDTCSR] = io[R_WDTCSR];
+        wdtNextAt += wdtPeriod;
+    }
+
+    cycles = target;
+}
+
+static uint64_t nextEventTime()
+{
+    uint64_t next = NEVER;
+
+    for (uint8_t i = 0; i < scheduledCount; ++i)
+    {
+        if (scheduled[i].cycle < next)
+            next = scheduled[i].cycle;
+    }
+
+    if ((io[R_WDTCSR] & (1 << 6)) && (wdtNextAt < next))
+        next = wdtNextAt;
+    if (eepromDoneAt < next)
+        next = eepromDoneAt;
+
+    if (sleepState != POWER_DOWN)
+    {
+        if (twiOperation.active && !(io[R_PRR] & (1 << 7)) && (twiOperation.doneAt < next))
+            next = twiOperation.doneAt;
+
+        uint64_t timerNext = timerNextInterrupt(&timer0);
+        if (timerNext < next)
+            next = timerNext;
+        timerNext = timerNextInterrupt(&timer2);
+        if (timerNext < next)
+            next = timerNext;
+    }
+
+    return (next <= cycles) ? (cycles + 1) : next;
+}
+
+static void detectWrites()//Lets the models react to what the firmware wrote
+{
+    if (io[R_TWCR] != shadow[R_TWCR])
+    {
+        uint8_t command = io[R_TWCR];
+        shadow[R_TWCR] = command;
+        twiCommand(command);
+        updatePINC();//The TWI may have taken or given back the pins
+    }
+
+    if ((io[R_DDRC] != shadow[R_DDRC]) || (io[R_PORTC] != shadow[R_PORTC]))
+    {
+        //A stuck slave counts the clocks given by hand (the rising edges of SCL)
+        bool sclWasLow = (shadow[R_DDRC] & SCL_PIN) && !(shadow[R_PORTC] & SCL_PIN);
+        bool sclIsLow = (io[R_DDRC] & SCL_PIN) && !(io[R_PORTC] & SCL_PIN);
+        if (sclWasLow && !sclIsLow && sdaHeldClocks && !(io[R_TWCR] & (1 << 2)))
+            --sdaHeldClocks;
+
+        shadow[R_DDRC] = io[R_DDRC];
+        shadow[R_PORTC] = io[R_PORTC];
+        updatePINC();
+    }
+
+    if (io[R_EECR] != shadow[R_EECR])
+    {
+        uint8_t oldValue = shadow[R_EECR];
+        shadow[R_EECR] = io[R_EECR];
+        eepromControl(oldValue, io[R_EECR]);
+    }
+
+    if (io[R_WDTCSR] != shadow[R_WDTCSR])
+    {
+        shadow[R_WDTCSR] = io[R_WDTCSR];
+        wdtControl(io[R_WDTCSR]);
+    }
+
+    if (io[R_GTCCR] & (1 << 1))//PSRASY resets the timer 2 prescaler, then clears itself
+    {
+        timer2.prescalerCount = 0;
+        io[R_GTCCR] &= ~(1 << 1);
+    }
+}
+
+static void dispatchPending()
+{
+    while (io[R_SREG] & 0x80)
+    {
+        void (*isr)(void) = pendingISR(false);
+        if (!isr)
+            break;
+
+        runISR(isr);
+    }
+}
+
+static void runISR(void (*isr)(void))//Like reti, the I bit is set again afterwards
+{
+    io[R_SREG] &= ~0x80;
+    isr();
+    io[R_SREG] |= 0x80;
+    detectWrites();
+}
+
+static void (*pendingISR(bool wakeSourcesOnly))(void)//Clears the flag of the one returned
+{
+    //In vector (priority) order
+    bool int0LowLevel = ((io[R_EICRA] & 0b11) == 0) && !((io[R_PIND] >> 2) & 1);
+    if ((io[R_EIMSK] & 1) && ((io[R_EIFR] & 1) || int0LowLevel))
+    {
+        io[R_EIFR] &= ~1;
+        return INT0_vect;
+    }
+
+    if ((io[R_PCICR] & (1 << 2)) && (io[R_PCIFR] & (1 << 2)))
+    {
+        io[R_PCIFR] &= ~(1 << 2);
+        return PCINT2_vect;
+    }
+
+    if ((io[R_WDTCSR] & (1 << 6)) && (io[R_WDTCSR] & (1 << 7)))
+    {
+        io[R_WDTCSR] &= ~(1 << 7);
+        shadow[R_WDTCSR] = io[R_WDTCSR];
+        return WDT_vect;
+    }
+
+    if (wakeSourcesOnly && (sleepState == POWER_DOWN))
+        return NULL;//Nothing else can wake the MCU from power down
+
+    if ((io[R_TIMSK2] & (1 << 1)) && (io[R_TIFR2] & (1 << 1)))
+    {
+        io[R_TIFR2] &= ~(1 << 1);
+        return TIMER2_COMPA_vect;
+    }
+
+    if ((io[R_TIMSK0] & 1) && (io[R_TIFR0] & 1))
+    {
+        io[R_TIFR0] &= ~1;
+        return TIMER0_OVF_vect;
+    }
+
+    if ((io[R_EECR] & (1 << 3)) && !(io[R_EECR] & (1 << 1)))//EERIE set and no write in progress
+        return EE_READY_vect;
+
+    if ((io[R_TWCR] & 0b10000101) == 0b10000101)//TWINT, TWEN and TWIE
+        return TWI_vect;
+
+    return NULL;
+}
+
+//TWI
+
+static void setTWCR(uint8_t value)//For changes made by the hardware
+{
+    io[R_TWCR] = shadow[R_TWCR] = value | TWCR_MARKER;
+}
+
+static void updatePINC()//The lines are low if anything pulls them low
+{
+    uint8_t pinc = SDA_PIN | SCL_PIN;
+    if (!(io[R_TWCR] & (1 << 2)))//The TWI doesn't own the pins
+        pinc &= ~(io[R_DDRC] & ~io[R_PORTC]);
+    if (sdaHeldClocks)
+        pinc &= ~SDA_PIN;
+
+    io[R_PINC] = shadow[R_PINC] = pinc;
+}
+
+static void twiCommand(uint8_t command)
+{
+    if (!(command & (1 << 2)))//TWEN cleared; the peripheral lets go of the bus
+    {
+        twiOperation.active = false;
+        busState = BUS_FREE;
+        addressed = NULL;
+        setTWCR(command & ~(1 << 7));
+        return;
+    }
+
+    if (!(command & (1 << 7)))
+        return;//TWINT wasn't written with a 1, so nothing new happens
+
+    if (twiOperation.active)
+        fatal("TWCR written while the TWI was busy");
+
+    setTWCR(command & ~(1 << 7));//Writing a 1 clears TWINT
+
+    if (command & (1 << 4))//Stop bit
+    {
+        if (addressed && addressed->stop)
+            addressed->stop();
+
+        addressed = NULL;
+        busState = BUS_FREE;
+
+        if (!(command & (1 << 5)))
+        {
+            twiBeginOperation(0, 0);
+            twiOperation.isStop = true;
+            return;
+        }
+
+        setTWCR(io[R_TWCR] & ~(1 << 4));//Followed by a start bit (TWSTO clears right away)
+    }
+
+    if (command & (1 << 5))//Start bit
+    {
+        if (sdaHeldClocks && (busState == BUS_FREE))
+            return;//The bus looks busy, so the TWI waits for a stop bit that never comes
+
+        if (busState == BUS_FREE)
+        {
+            ++stats.i2cTransactions;
+            twiBeginOperation(0x08, 0);
+        }
+        else
+            twiBeginOperation(0x10, 0);//Repeated start
+
+        busState = ADDRESS_NEXT;
+        return;
+    }
+
+    switch (busState)
+    {
+        case ADDRESS_NEXT:
+        {
+            uint8_t address = io[R_TWDR] >> 1;
+            bool read = io[R_TWDR] & 1;
+
+            addressed = NULL;
+            for (uint8_t i = 0; i < deviceCount; ++i)
+            {
+                if (devices[i]->address == address)
+                    addressed = devices[i];
+            }
+
+            if (addressed && addressed->start && !addressed->start(read))
+                addressed = NULL;//Present, but not answering
+
+            if (read)
+                twiBeginOperation(addressed ? 0x40 : 0x48, 1);
+            else
+                twiBeginOperation(addressed ? 0x18 : 0x20, 1);
+
+            busState = read ? READING : WRITING;
+            break;
+        }
+        case WRITING:
+        {
+            bool ack = addressed && addressed->write && addressed->write(io[R_TWDR]);
+            twiBeginOperation(ack ? 0x28 : 0x30, 1);
+            break;
+        }
+        case READING:
+        {
+            bool ack = command & (1 << 6);//TWEA
+            twiBeginOperation(ack ? 0x50 : 0x58, 1);
+            twiOperation.hasData = true;
+            twiOperation.data = (addressed && addressed->read) ? addressed->read() : 0xFF;
+            break;
+        }
+        default:
+        {
+            fatal("TWI byte transfer without a start bit");
+            break;
+        }
+    }
+}
+
+static void twiBeginOperation(uint8_t status, uint8_t bytes)
+{
+    twiOperation.active = true;
+    twiOperation.status = status;
+    twiOperation.isStop = false;
+    twiOperation.hasData = false;
+    twiOperation.doneAt = cycles + (bytes ? (9 * bytes * sclPeriod()) : sclPeriod());
+
+    stats.i2cBytes += bytes;
+}
+
+static uint64_t sclPeriod()//In cycles
+{
+    static const uint8_t prescalers[4] = {1, 4, 16, 64};
+    return 16 + (2 * (uint64_t)io[R_TWBR] * prescalers[io[R_TWSR] & 0b11]);
+}
+
+//EEPROM
+
+static void eepromControl(uint8_t oldValue, uint8_t newValue)
+{
+    uint16_t address = ((io[R_EEARH] << 8) | io[R_EEARL]) % HAL_EEPROM_SIZE;
+
+    if (newValue & 1)//EERE (the CPU is halted for the read, so it finishes right away)
+    {
+        if (eepromDoneAt != NEVER)
+            fatal("EEPROM read during a write");
+
+        io[R_EEDR] = shadow[R_EEDR] = eeprom[address];
+        ++stats.eepromReads;
+        newValue &= ~1;
+    }
+
+    if ((newValue & (1 << 1)) && !(oldValue & (1 << 1)))//EEPE
+    {
+        if (oldValue & (1 << 2))//EEMPE was set first (timed sequence)
+        {
+            eeprom[address] = io[R_EEDR];//Erase and write
+            eepromDoneAt = cycles + EEPROM_WRITE_CYCLES;
+            ++stats.eepromWrites;
+        }
+        else
+            newValue &= ~(1 << 1);//Ignored
+
+        newValue &= ~(1 << 2);
+    }
+
+    io[R_EECR] = shadow[R_EECR] = newValue;
+}
+
+//Watchdog
+
+static void wdtControl(uint8_t newValue)
+{
+    if ((newValue & 0b00011000) == 0b00011000)//WDCE and WDE (start of timed sequence)
+    {
+        wdtChangeEnabled = true;
+        return;
+    }
+
+    if (!wdtChangeEnabled)
+        return;//Only WDIE/WDIF could change, which doesn't matter here
+
+    wdtChangeEnabled = false;
+
+    if (newValue & (1 << 3))
+        fatal("Watchdog reset mode isn't simulated");
+
+    if (newValue & (1 << 6))//Interrupt mode
+    {
+        uint8_t prescaler = ((newValue >> 2) & 0b1000) | (newValue & 0b111);
+        wdtPeriod = (uint64_t)WDT_BASE_CYCLES << prescaler;
+        wdtNextAt = cycles + wdtPeriod;
+    }
+    else//Stopped
+    {
+        wdtPeriod = 0;
+        wdtNextAt = NEVER;
+    }
+}
+
+//Timers
+
+static bool timerRunning(const hardwareTimer_t* timer)
+{
+    return timer->prescalers[io[timer->tccrB] & 0b111] && !(io[R_PRR] & (1 << timer->prrBit));
+}
+
+static uint8_t timerTop(const hardwareTimer_t* timer)//CTC (timer 2 only, as used by timer.c) or normal
+{
+    bool ctc = (timer == &timer2) && ((io[R_TCCR2A] & 0b11) == 0b10);
+    return ctc ? io[R_OCR2A] : 0xFF;
+}
+
+static void advanceTimer(hardwareTimer_t* timer, uint64_t elapsed)
+{
+    if (!timerRunning(timer))
+        return;
+
+    uint16_t prescaler = timer->prescalers[io[timer->tccrB] & 0b111];
+    timer->prescalerCount += elapsed;
+    uint64_t ticks = timer->prescalerCount / prescaler;
+    timer->prescalerCount %= prescaler;
+
+    if (!ticks)
+        return;
+
+    uint16_t top = timerTop(timer);
+    uint16_t count = io[timer->tcnt];
+    uint64_t untilWrap = (count <= top) ? ((top - count) + 1) : ((0x100 - count) + top + 1);
+
+    if (ticks >= untilWrap)
+    {
+        io[timer->tifr] |= 1 << timer->flagBit;
+        count = (ticks - untilWrap) % (top + 1);
+    }
+    else
+        count += ticks;
+
+    io[timer->tcnt] = shadow[timer->tcnt] = count;
+}
+
+static uint64_t timerNextInterrupt(const hardwareTimer_t* timer)
+{
+    if (!timerRunning(timer) || !(io[timer->timsk] & (1 << timer->flagBit)))
+        return NEVER;
+    if (io[timer->tifr] & (1 << timer->flagBit))
+        return cycles;//Already pending
+
+    uint16_t prescaler = timer->prescalers[io[timer->tccrB] & 0b111];
+    uint16_t top = timerTop(timer);
+    uint16_t count = io[timer->tcnt];
+    uint64_t untilWrap = (count <= top) ? ((top - count) + 1) : ((0x100 - count) + top + 1);
+
+    return cycles + (untilWrap * prescaler) - timer->prescalerCount;
+}
+
+/* Default ISRs (for vectors the firmware doesn't use in this configuration) */
+
+__attribute__((weak)) void INT0_vect(void) {}
+__attribute__((weak)) void PCINT2_vect(void) {}
+__attribute__((weak)) void WDT_vect(void) {}
+__attribute__((weak)) void TIMER2_COMPA_vect(void) {}
+__attribute__((weak)) void TIMER0_OVF_vect(void) {}
+__attribute__((weak)) void TWI_vect(void) {}
+
+__attribute__((weak)) void EE_READY_vect(void)
+{
+    io[R_EECR] &= ~(1 << 3);//Avoid firing forever
+}
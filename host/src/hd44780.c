@@ -0,0 +1,192 @@
+/* HD44780 model
+ * By: John Jekel
+ *
+ * See hd44780.h.
+*/
+
+#include "hd44780.h"
+#include "hal.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Static Variables */
+
+static uint8_t ddram[0x80];
+static uint8_t cgram[64];
+static uint8_t addressCounter;
+static bool addressingCGRAM;
+
+static bool fourBitMode;
+static bool highNibbleNext;//In 4 bit mode
+static uint8_t highNibble;
+static bool displayOn;
+
+static bool powered;
+static uint8_t pins;//Last value written to the PCF8574
+static HD44780_stats_t stats;
+
+/* Static Function Declarations */
+
+static bool checkPower();
+static bool start(bool read);
+static bool write(uint8_t byte);
+static void latch(uint8_t byte, bool data);
+
+//How the bus sees the functions above
+static const HAL_i2cDevice_t device = {HD44780_ADDRESS, start, write, NULL, NULL};
+
+/* Functions */
+
+void HD44780_attach()
+{
+    powered = false;
+    HD44780_clearStats();
+    HAL_attachI2CDevice(&device);
+}
+
+void HD44780_getLine(uint8_t line, char string[17])
+{
+    memcpy(string, &ddram[line ? 0x40 : 0x00], 16);
+    string[16] = '\0';
+}
+
+const uint8_t* HD44780_getGlyph(uint8_t index)
+{
+    return &cgram[(index & 0x07) * 8];
+}
+
+bool HD44780_isPowered()
+{
+    return checkPower();
+}
+
+bool HD44780_isDisplayOn()
+{
+    return checkPower() && displayOn;
+}
+
+bool HD44780_isBacklightOn()
+{
+    return checkPower() && ((pins >> 3) & 1);
+}
+
+const HD44780_stats_t* HD44780_getStats()
+{
+    return &stats;
+}
+
+void HD44780_clearStats()
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+/* Static Functions */
+
+static bool checkPower()//Returns true if the module has power; resets it when power comes back
+{
+    bool hasPower = !(HAL_getPORTB() & (1 << 2));//PB2 drives a PNP transistor
+
+    if (hasPower && !powered)
+    {
+        memset(ddram, ' ', sizeof(ddram));
+        memset(cgram, 0, sizeof(cgram));//Really garbage
+        addressCounter = 0;
+        addressingCGRAM = false;
+        fourBitMode = false;
+        highNibbleNext = true;
+        displayOn = false;
+        pins = 0xFF;//The PCF8574's pins are weakly pulled up after power on
+    }
+
+    powered = hasPower;
+    return hasPower;
+}
+
+static bool start(bool read)
+{
+    return checkPower();//Without power, nothing answers
+}
+
+static bool write(uint8_t byte)
+{
+    ++stats.i2cBytes;
+
+    bool fallingEdge = (pins & (1 << 2)) && !(byte & (1 << 2));
+    pins = byte;
+
+    if (!fallingEdge || (byte & (1 << 1)))//Nothing latched, or a read (never used)
+        return true;
+
+    uint8_t nibble = byte & 0xF0;
+    bool data = byte & 1;
+
+    if (!fourBitMode)//Only D7 to D4 are connected, so D3 to D0 read as 0
+        latch(nibble, data);
+    else if (highNibbleNext)
+    {
+        highNibble = nibble;
+        highNibbleNext = false;
+    }
+    else
+    {
+        highNibbleNext = true;
+        latch(highNibble | (nibble >> 4), data);
+    }
+
+    return true;
+}
+
+static void latch(uint8_t byte, bool data)
+{
+    if (data)
+    {
+        if (addressingCGRAM)
+        {
+            cgram[addressCounter & 0x3F] = byte;
+            addressCounter = (addressCounter + 1) & 0x3F;
+            ++stats.glyphRows;
+        }
+        else
+        {
+            ddram[addressCounter & 0x7F] = byte;
+            addressCounter = (addressCounter + 1) & 0x7F;
+            ++stats.characters;
+        }
+
+        return;
+    }
+
+    ++stats.commands;
+
+    if (byte & 0x80)//Set DDRAM address
+    {
+        addressCounter = byte & 0x7F;
+        addressingCGRAM = false;
+    }
+    else if (byte & 0x40)//Set CGRAM address
+    {
+        addressCounter = byte & 0x3F;
+        addressingCGRAM = true;
+    }
+    else if (byte & 0x20)//Function set
+    {
+        fourBitMode = !(byte & 0x10);
+        highNibbleNext = true;
+    }
+    else if (byte & 0x08)//Display control
+        displayOn = byte & 0x04;
+    else if (byte == 0x01)//Clear display
+    {
+        memset(ddram, ' ', sizeof(ddram));
+        addressCounter = 0;
+        addressingCGRAM = false;
+    }
+    else if ((byte & 0xFE) == 0x02)//Return home
+    {
+        addressCounter = 0;
+        addressingCGRAM = false;
+    }
+    //Entry mode set and shifts are left at their defaults (increment, no shift)
+}
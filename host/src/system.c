@@ -0,0 +1,133 @@
+/* Simulated system
+ * By: John Jekel
+ *
+ * See system.h.
+*/
+
+#define _XOPEN_SOURCE 700//For ucontext
+
+#include "system.h"
+#include "hal.h"
+#include "ds3231.h"
+#include "hd44780.h"
+
+#include "power.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+/* Constants/Macros */
+
+#define FIRMWARE_STACK_SIZE (256 * 1024)
+
+#define R_TCCR1A 0x80
+#define R_PRR 0x64
+
+/* Static Variables */
+
+static ucontext_t harnessContext;
+static ucontext_t firmwareContext;
+static uint8_t firmwareStack[FIRMWARE_STACK_SIZE];
+static bool booted;
+
+/* Static Function Declarations */
+
+int FIRMWARE_main();//main.c, renamed by host/CMakeLists.txt
+
+static void firmwareEntry();
+static void yieldToHarness();
+
+/* Functions */
+
+void SYSTEM_boot(const uint8_t rtcTime[7])
+{
+    if (booted)
+    {
+        fprintf(stderr, "SYSTEM: Can only boot once per process\n");
+        abort();
+    }
+
+    booted = true;
+
+    HAL_reset();
+    DS3231_attach();
+    HD44780_attach();
+
+    if (rtcTime)
+        memcpy(DS3231_getRegisters(), rtcTime, 7);
+
+    getcontext(&firmwareContext);
+    firmwareContext.uc_stack.ss_sp = firmwareStack;
+    firmwareContext.uc_stack.ss_size = sizeof(firmwareStack);
+    firmwareContext.uc_link = NULL;//main never returns
+    makecontext(&firmwareContext, firmwareEntry, 0);
+}
+
+void SYSTEM_runUntil(uint64_t cycle)
+{
+    if (cycle <= HAL_getCycles())
+        return;
+
+    HAL_schedule(cycle, yieldToHarness);
+    swapcontext(&harnessContext, &firmwareContext);
+}
+
+void SYSTEM_runFor(uint64_t cycles)
+{
+    SYSTEM_runUntil(HAL_getCycles() + cycles);
+}
+
+void SYSTEM_setButtons(uint8_t pushed)
+{
+    uint8_t pind = HAL_getPIND();
+    HAL_setPIND((pind | SYSTEM_BUTTONS) & ~(pushed & SYSTEM_BUTTONS));
+}
+
+void SYSTEM_press(uint8_t buttons, uint64_t holdCycles)
+{
+    SYSTEM_setButtons(buttons);
+    SYSTEM_runFor(holdCycles);
+    SYSTEM_setButtons(0);
+}
+
+bool SYSTEM_isBuzzerOn()
+{
+    return !(HAL_peek(R_PRR) & (1 << 3)) && (HAL_peek(R_TCCR1A) & 0b01000000);
+}
+
+double SYSTEM_getCharge()
+{
+    const HAL_stats_t* stats = HAL_getStats();
+    uint64_t cycles = HAL_getCycles();
+    uint64_t idleCycles = stats->awakeCycles - stats->runningCycles;
+    uint64_t powerDownCycles = cycles - stats->awakeCycles;
+
+    //uA * cycles, then uAh
+    double charge = ((double)stats->runningCycles * POWER_CURRENT_ACTIVE) +
+                    ((double)idleCycles * POWER_CURRENT_IDLE) +
+                    ((double)powerDownCycles * POWER_CURRENT_POWER_DOWN) +
+                    ((double)cycles * POWER_CURRENT_ALWAYS) +
+                    ((double)stats->pb2LowCycles * POWER_CURRENT_LCD) +
+                    ((double)stats->timer1OutputCycles * POWER_CURRENT_BUZZER) +
+                    ((double)stats->twiPoweredCycles * POWER_CURRENT_I2C);
+    return charge / SYSTEM_CYCLES_PER_SECOND / 3600;
+}
+
+/* Static Functions */
+
+static void firmwareEntry()
+{
+    FIRMWARE_main();
+
+    fprintf(stderr, "SYSTEM: main returned\n");
+    abort();
+}
+
+static void yieldToHarness()//Runs in the firmware's context (from within the HAL)
+{
+    swapcontext(&firmwareContext, &harnessContext);
+}
@@ -0,0 +1,158 @@
+/* Event traces
+ * By: John Jekel
+ *
+ * See trace.h. The recorder watches PIND through the HAL: falling edges on PD2 become int0
+ * events and changes to the button pins become pind events, each with the RTC's registers
+ * before them if they changed (the firmware reads them in response to either).
+*/
+
+#include "trace.h"
+#include "hal.h"
+#include "ds3231.h"
+
+#include "settings.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Constants/Macros */
+
+#define CYCLES_PER_US ((uint64_t)F_CPU / 1000000)
+#define INT0_PIN (1 << 2)
+#define BUTTON_PINS 0b11110011
+
+/* Static Variables */
+
+static FILE* recording;
+static uint8_t recordedRTC[19];
+
+static const char* const typeNames[] = {"rtc", "int0", "pind", "settings", "end"};
+
+/* Static Function Declarations */
+
+static void watchPIND(uint8_t oldValue, uint8_t newValue);
+static void writeEvent(TRACE_type_t type);
+
+/* Functions */
+
+void TRACE_startRecording(FILE* file)
+{
+    recording = file;
+    fprintf(recording, "# atmegaclock2 trace (see host/include/trace.h)\n");
+
+    memcpy(recordedRTC, DS3231_getRegisters(), sizeof(recordedRTC));
+    writeEvent(TRACE_RTC);
+    HAL_watchPIND(watchPIND);
+}
+
+void TRACE_recordRTC()
+{
+    if (recording && memcmp(recordedRTC, DS3231_getRegisters(), sizeof(recordedRTC)))
+    {
+        memcpy(recordedRTC, DS3231_getRegisters(), sizeof(recordedRTC));
+        writeEvent(TRACE_RTC);
+    }
+}
+
+void TRACE_recordSettings()
+{
+    if (recording)
+        writeEvent(TRACE_SETTINGS);
+}
+
+void TRACE_stopRecording()
+{
+    if (!recording)
+        return;
+
+    writeEvent(TRACE_END);
+    HAL_watchPIND(NULL);
+    fflush(recording);
+    recording = NULL;
+}
+
+bool TRACE_read(FILE* file, TRACE_event_t* event)
+{
+    char line[256];
+
+    while (fgets(line, sizeof(line), file))
+    {
+        if ((line[0] == '#') || (line[0] == '\n'))
+            continue;
+
+        unsigned long long us;
+        char typeName[16];
+        int consumed;
+        if (sscanf(line, "%llu %15s%n", &us, typeName, &consumed) != 2)
+            return false;
+
+        event->cycle = us * CYCLES_PER_US;
+        memset(event->data, 0, sizeof(event->data));
+
+        uint8_t type = 0;
+        while ((type <= TRACE_END) && strcmp(typeName, typeNames[type]))
+            ++type;
+        event->type = type;
+
+        //The data is all hex (or decimal for settings) bytes
+        uint8_t expectedBytes = (type == TRACE_RTC) ? 19 : (type == TRACE_PIND) ? 1 :
+                                (type == TRACE_SETTINGS) ? 2 : 0;
+        const char* format = (type == TRACE_SETTINGS) ? "%u%n" : "%x%n";
+        const char* data = line + consumed;
+        for (uint8_t i = 0; i < expectedBytes; ++i)
+        {
+            unsigned byte;
+            int length;
+            if (sscanf(data, format, &byte, &length) != 1)
+                return false;
+
+            event->data[i] = byte;
+            data += length;
+        }
+
+        return type <= TRACE_END;
+    }
+
+    return false;
+}
+
+const char* TRACE_getTypeName(TRACE_type_t type)
+{
+    return typeNames[type];
+}
+
+/* Static Functions */
+
+static void watchPIND(uint8_t oldValue, uint8_t newValue)
+{
+    if ((oldValue & INT0_PIN) && !(newValue & INT0_PIN))
+    {
+        TRACE_recordRTC();
+        writeEvent(TRACE_INT0);
+    }
+
+    if ((oldValue ^ newValue) & BUTTON_PINS)
+    {
+        TRACE_recordRTC();//The firmware reads the time when woken by a button, even in SLEEP
+        fprintf(recording, "%llu pind %02x\n",
+                (unsigned long long)(HAL_getCycles() / CYCLES_PER_US), newValue);
+    }
+}
+
+static void writeEvent(TRACE_type_t type)
+{
+    fprintf(recording, "%llu %s", (unsigned long long)(HAL_getCycles() / CYCLES_PER_US),
+            typeNames[type]);
+
+    if (type == TRACE_RTC)
+    {
+        for (uint8_t i = 0; i < sizeof(recordedRTC); ++i)
+            fprintf(recording, " %02x", recordedRTC[i]);
+    }
+    else if (type == TRACE_SETTINGS)
+        fprintf(recording, " %u %u", SETTINGS_data.alarmEnabled, SETTINGS_data.clockTimeout);
+
+    fputc('\n', recording);
+}
@@ -0,0 +1,488 @@
+/* Sweep
+ * By: John Jekel
+ *
+ * Runs many independent scenarios (combinations of the clock timeout, the alarm time, the
+ * starting date and a pattern of button presses) through the whole firmware (see system.h) in
+ * parallel, and aggregates the charge used, wakeups and I2C traffic of each. While the display
+ * shows the time, it is checked against the RTC's registers half way between seconds; any
+ * difference between what CLOCK mode displays (topLine and bottomLine) and the true time is
+ * reported as a divergence, and fails the sweep.
+ *
+ * The firmware's state is in globals, so there can only be one instance per process: instead of
+ * threads, there is a worker process per core, each taking the next scenario from a shared
+ * counter (so faster workers take more) and running it in a child forked from a clean state.
+ * The results are written to shared memory.
+ *
+ * Usage: sweep [-j workers] [-d duration in hours] [-r random scenarios] [-s seed] [-v]
+ *  By default, every combination in the tables below is run for 24 hours on every core.
+ *  -r adds that many more scenarios with random settings, start times and patterns.
+ *  -v prints the results of every scenario.
+*/
+
+#define _DEFAULT_SOURCE//For MAP_ANONYMOUS
+
+#include "hal.h"
+#include "ds3231.h"
+#include "hd44780.h"
+#include "system.h"
+
+#include "settings.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Constants/Macros */
+
+#define SECOND SYSTEM_CYCLES_PER_SECOND
+#define MS SYSTEM_CYCLES_PER_MS
+
+#define MAX_PRESSES 12
+#define AWAKE_STEP (100 * MS)
+#define ASLEEP_STEP (1 * SECOND)
+#define CHECK_DELAY (400 * MS)//After the second changes (the step is 100ms, so 400 to 500ms)
+#define MAX_LISTED_DIVERGENCES 20
+
+#define toBCD(value) ((uint8_t)((((value) / 10) << 4) | ((value) % 10)))
+#define lengthOf(array) (sizeof(array) / sizeof((array)[0]))
+
+/* Typedefs */
+
+typedef struct
+{
+    const char* name;
+    uint32_t period;//Seconds; the presses repeat (0 for no presses)
+    uint8_t count;
+    struct {uint32_t at; uint8_t buttons; uint16_t hold;} presses[MAX_PRESSES];//ms into the period
+} pattern_t;
+
+typedef struct
+{
+    uint8_t timeout;
+    int16_t alarm;//Minute of the day, or -1 for disabled
+    uint8_t startTime[7];//DS3231 registers 0x0 to 0x6
+    uint8_t pattern;
+} scenario_t;
+
+typedef struct
+{
+    bool finished;
+    double charge;//uAh
+    uint32_t wakeups;
+    uint32_t i2cTransactions;
+    uint32_t i2cBytes;
+    uint32_t checks;
+    uint32_t divergences;
+    uint32_t firstDivergenceAt;//Seconds
+    char displayed[40];//At the first divergence
+    char expected[40];
+} result_t;
+
+typedef struct//Shared with the workers (and their children)
+{
+    atomic_uint next;//The next scenario to run
+    result_t results[];
+} shared_t;
+
+/* Static Variables */
+
+static const uint8_t timeouts[] = {1, 5, 30, 99};
+static const int16_t alarms[] = {-1, 0, 7 * 60, (23 * 60) + 59};
+static const uint8_t startTimes[][7] =//A few seconds before midnight, and other rollovers
+{
+    {0x50, 0x59, 0x23, 0x04, 0x15, 0x06, 0x23},//Thu 2023-06-15
+    {0x50, 0x59, 0x23, 0x07, 0x30, 0x04, 0x23},//Sun 2023-04-30 (30 day month)
+    {0x50, 0x59, 0x23, 0x03, 0x28, 0x02, 0x24},//Wed 2024-02-28 (leap year)
+    {0x50, 0x59, 0x23, 0x07, 0x31, 0x12, 0x23},//Sun 2023-12-31
+    {0x50, 0x59, 0x23, 0x04, 0x31, 0x12, 0x99},//Thu 2099-12-31 (century)
+};
+static const pattern_t patterns[] =//Each starts after the longest timeout, so they start in SLEEP
+{
+    {"none", 0, 0, {{0}}},
+    {"hourly", 3600, 1, {{200000, SYSTEM_RIGHT, 100}}},//Check the time
+    {"menu", 6 * 3600, 7,//Wake, open the menu, change a digit and back, then leave it
+     {{200000, SYSTEM_RIGHT, 100}, {200300, SYSTEM_ENTER, 100}, {201000, SYSTEM_RIGHT, 100},
+      {201500, SYSTEM_UP, 100}, {202000, SYSTEM_DOWN, 100}, {202500, SYSTEM_LEFT, 100},
+      {203000, SYSTEM_EXIT, 100}}},
+    {"rapid", 3600, 11,//Mashing a button (which opens the menu), then leaving the menu
+     {{200000, SYSTEM_UP, 50}, {200200, SYSTEM_UP, 50}, {200400, SYSTEM_UP, 50},
+      {200600, SYSTEM_UP, 50}, {200800, SYSTEM_UP, 50}, {201000, SYSTEM_UP, 50},
+      {201200, SYSTEM_UP, 50}, {201400, SYSTEM_UP, 50}, {201600, SYSTEM_UP, 50},
+      {201800, SYSTEM_UP, 50}, {203000, SYSTEM_EXIT, 100}}},
+    {"hold", 6 * 3600, 1, {{200000, SYSTEM_DOWN, 10000}}},//Holding a button down
+};
+static const char dayNames[7][4] = {"Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"};
+
+static bool verbose;
+
+/* Static Function Declarations */
+
+static uint32_t makeScenarios(scenario_t** scenarios, uint32_t randomCount, unsigned seed);
+static void worker(const scenario_t* scenarios, result_t* results, uint32_t count,
+                   atomic_uint* next, uint64_t duration);
+static void runScenario(const scenario_t* scenario, result_t* result, uint64_t duration);
+static void checkDisplay(result_t* result);
+static void describe(const scenario_t* scenario, char* string, size_t size);
+static void printSummary(const scenario_t* scenarios, const result_t* results, uint32_t count,
+                         uint64_t duration);
+
+/* Functions */
+
+int main(int argc, char** argv)
+{
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    double hours = 24;
+    uint32_t randomCount = 0;
+    unsigned seed = 1;
+
+    int option;
+    while ((option = getopt(argc, argv, "j:d:r:s:v")) != -1)
+    {
+        switch (option)
+        {
+            case 'j':
+                workers = atol(optarg);
+                break;
+            case 'd':
+                hours = atof(optarg);
+                break;
+            case 'r':
+                randomCount = atol(optarg);
+                break;
+            case 's':
+                seed = atol(optarg);
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-j workers] [-d hours] [-r random] [-s seed] [-v]\n",
+                        argv[0]);
+                return 2;
+        }
+    }
+
+    if ((workers < 1) || (hours <= 0))
+    {
+        fprintf(stderr, "Need at least 1 worker and a positive duration\n");
+        return 2;
+    }
+
+    scenario_t* scenarios;
+    uint32_t count = makeScenarios(&scenarios, randomCount, seed);
+    uint64_t duration = (uint64_t)(hours * 3600) * SECOND;
+
+    size_t sharedSize = sizeof(shared_t) + (count * sizeof(result_t));
+    shared_t* shared = mmap(NULL, sharedSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                            -1, 0);
+    if (shared == MAP_FAILED)
+    {
+        perror("mmap");
+        return 2;
+    }
+    atomic_init(&shared->next, 0);//The rest is zeroed by mmap
+    result_t* results = shared->results;
+
+    printf("Running %u scenarios of %g hours on %ld workers\n", count, hours, workers);
+    fflush(stdout);
+
+    for (long i = 0; i < workers; ++i)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            worker(scenarios, results, count, &shared->next, duration);
+            _exit(0);
+        }
+        else if (pid < 0)
+        {
+            perror("fork");
+            return 2;
+        }
+    }
+
+    while (wait(NULL) > 0)
+        continue;//Until every worker is done
+
+    printSummary(scenarios, results, count, duration);
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (!results[i].finished || results[i].divergences)
+            return 1;
+    }
+
+    return 0;
+}
+
+/* Static Functions */
+
+static uint32_t makeScenarios(scenario_t** scenarios, uint32_t randomCount, unsigned seed)
+{
+    uint32_t gridCount = lengthOf(timeouts) * lengthOf(alarms) * lengthOf(startTimes) *
+                         lengthOf(patterns);
+    uint32_t count = gridCount + randomCount;
+    *scenarios = calloc(count, sizeof(scenario_t));
+
+    scenario_t* scenario = *scenarios;
+    for (uint8_t t = 0; t < lengthOf(timeouts); ++t)
+    {
+        for (uint8_t a = 0; a < lengthOf(alarms); ++a)
+        {
+            for (uint8_t s = 0; s < lengthOf(startTimes); ++s)
+            {
+                for (uint8_t p = 0; p < lengthOf(patterns); ++p, ++scenario)
+                {
+                    scenario->timeout = timeouts[t];
+                    scenario->alarm = alarms[a];
+                    memcpy(scenario->startTime, startTimes[s], 7);
+                    scenario->pattern = p;
+                }
+            }
+        }
+    }
+
+    //Random ones start at any time in 2000 to 2199 (the day of the month is at most 28, so
+    //it's always valid; the day of the week doesn't have to match the date for these tests)
+    srand(seed);
+    for (uint32_t i = 0; i < randomCount; ++i, ++scenario)
+    {
+        scenario->timeout = 1 + (rand() % 99);
+        scenario->alarm = (rand() % 5) ? (rand() % (24 * 60)) : -1;
+        scenario->startTime[0x0] = toBCD(rand() % 60);
+        scenario->startTime[0x1] = toBCD(rand() % 60);
+        scenario->startTime[0x2] = toBCD(rand() % 24);
+        scenario->startTime[0x3] = 1 + (rand() % 7);
+        scenario->startTime[0x4] = toBCD(1 + (rand() % 28));
+        scenario->startTime[0x5] = toBCD(1 + (rand() % 12)) | ((rand() % 2) ? 0x80 : 0x00);
+        scenario->startTime[0x6] = toBCD(rand() % 100);
+        scenario->pattern = rand() % lengthOf(patterns);
+    }
+
+    return count;
+}
+
+static void worker(const scenario_t* scenarios, result_t* results, uint32_t count,
+                   atomic_uint* next, uint64_t duration)
+{
+    uint32_t index;
+    while ((index = atomic_fetch_add(next, 1)) < count)
+    {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            runScenario(&scenarios[index], &results[index], duration);
+            _exit(0);
+        }
+        else if (pid > 0)
+            waitpid(pid, NULL, 0);//If the child crashed, the result is left unfinished
+    }
+}
+
+static void runScenario(const scenario_t* scenario, result_t* result, uint64_t duration)
+{
+    SYSTEM_boot(scenario->startTime);
+    uint8_t* rtc = DS3231_getRegisters();
+    if (scenario->alarm >= 0)
+    {
+        rtc[0xB] = toBCD(scenario->alarm % 60);
+        rtc[0xC] = toBCD(scenario->alarm / 60);
+    }
+
+    //Change the settings after the firmware loads them (during the splash screen)
+    SYSTEM_runFor(1 * SECOND);
+    SETTINGS_data.clockTimeout = scenario->timeout;
+    SETTINGS_data.alarmEnabled = scenario->alarm >= 0;
+
+    const pattern_t* pattern = &patterns[scenario->pattern];
+    uint64_t periodStart = HAL_getCycles();
+    uint8_t press = 0;
+    bool pushed = false;
+    uint32_t lastSecondsElapsed = DS3231_getSecondsElapsed();
+    uint64_t checkAt = UINT64_MAX;
+
+    while (HAL_getCycles() < duration)
+    {
+        //Run until the next step, press/release, check or the end, whichever is first
+        uint64_t target = HAL_getCycles() + (HD44780_isDisplayOn() ? AWAKE_STEP : ASLEEP_STEP);
+        uint64_t pressAt = UINT64_MAX;
+        if (pattern->period)
+        {
+            pressAt = periodStart + (pattern->presses[press].at * MS);
+            if (pushed)
+                pressAt += pattern->presses[press].hold * MS;
+        }
+
+        if (pressAt < target)
+            target = pressAt;
+        if (checkAt < target)
+            target = checkAt;
+        if (duration < target)
+            target = duration;
+
+        SYSTEM_runUntil(target);
+
+        if (target == pressAt)
+        {
+            pushed = !pushed;
+            SYSTEM_setButtons(pushed ? pattern->presses[press].buttons : 0);
+            if (!pushed && (++press == pattern->count))
+            {
+                press = 0;
+                periodStart += pattern->period * SECOND;
+            }
+        }
+
+        if (target == checkAt)
+        {
+            checkAt = UINT64_MAX;
+            checkDisplay(result);
+        }
+
+        if (DS3231_getSecondsElapsed() != lastSecondsElapsed)
+        {
+            lastSecondsElapsed = DS3231_getSecondsElapsed();
+            checkAt = HAL_getCycles() + CHECK_DELAY;
+        }
+    }
+
+    const HAL_stats_t* stats = HAL_getStats();
+    result->charge = SYSTEM_getCharge();
+    result->wakeups = stats->powerDownWakeups;
+    result->i2cTransactions = stats->i2cTransactions;
+    result->i2cBytes = stats->i2cBytes;
+    result->finished = true;
+}
+
+static void checkDisplay(result_t* result)
+{
+    if (!HD44780_isPowered() || !HD44780_isDisplayOn())
+        return;
+
+    char top[17], bottom[17];
+    HD44780_getLine(0, top);
+    HD44780_getLine(1, bottom);
+
+    //Only CLOCK mode (the menu's time and date screens say "Set")
+    bool minuteResolution = top[6] != ':';
+    if ((top[3] != ':') || (bottom[3] != '/') || (bottom[6] != '/') || strstr(top, "Set"))
+        return;
+
+    const uint8_t* rtc = DS3231_getRegisters();
+    char expectedTop[16], expectedBottom[24];
+    snprintf(expectedTop, sizeof(expectedTop), "%02x:%02x:%02x", rtc[0x2], rtc[0x1], rtc[0x0]);
+    snprintf(expectedBottom, sizeof(expectedBottom), "%02x/%02x/2%u%02x %s", rtc[0x4],
+             rtc[0x5] & 0x1F, rtc[0x5] >> 7, rtc[0x6], dayNames[(rtc[0x3] + 6) % 7]);
+
+    ++result->checks;
+    if (!memcmp(top + 1, expectedTop, minuteResolution ? 5 : 8) &&
+        !memcmp(bottom + 1, expectedBottom, 14))
+        return;
+
+    if (!result->divergences)
+    {
+        result->firstDivergenceAt = HAL_getCycles() / SECOND;
+        snprintf(result->displayed, sizeof(result->displayed), "%.8s %.14s", top + 1, bottom + 1);
+        snprintf(result->expected, sizeof(result->expected), "%s %s", expectedTop,
+                 expectedBottom);
+    }
+    ++result->divergences;
+}
+
+static void describe(const scenario_t* scenario, char* string, size_t size)
+{
+    const uint8_t* time = scenario->startTime;
+    char alarm[12] = "off";
+    if (scenario->alarm >= 0)
+        snprintf(alarm, sizeof(alarm), "%02d:%02d", scenario->alarm / 60, scenario->alarm % 60);
+
+    snprintf(string, size, "start %u%02x-%02x-%02x %02x:%02x:%02x, timeout %2u, alarm %s, %s",
+             20 + (time[0x5] >> 7), time[0x6], time[0x5] & 0x1F, time[0x4], time[0x2], time[0x1],
+             time[0x0], scenario->timeout, alarm, patterns[scenario->pattern].name);
+}
+
+static void printSummary(const scenario_t* scenarios, const result_t* results, uint32_t count,
+                         uint64_t duration)
+{
+    double days = (double)duration / SECOND / 86400;
+    uint32_t finished = 0, divergent = 0, listed = 0;
+    double totalCharge = 0, maxCharge = 0;
+    uint64_t totalWakeups = 0, totalTransactions = 0, totalBytes = 0, totalChecks = 0;
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const result_t* result = &results[i];
+        char description[96];
+        describe(&scenarios[i], description, sizeof(description));
+
+        if (!result->finished)
+        {
+            printf("CRASHED: %s\n", description);
+            continue;
+        }
+
+        if (verbose)
+        {
+            printf("%s: %.3f mAh/day, %u wakeups, %u I2C transactions, %u I2C bytes, "
+                   "%u checks\n", description, result->charge / 1000 / days, result->wakeups,
+                   result->i2cTransactions, result->i2cBytes, result->checks);
+        }
+
+        ++finished;
+        totalCharge += result->charge;
+        if (result->charge > maxCharge)
+            maxCharge = result->charge;
+        totalWakeups += result->wakeups;
+        totalTransactions += result->i2cTransactions;
+        totalBytes += result->i2cBytes;
+        totalChecks += result->checks;
+
+        if (result->divergences)
+        {
+            ++divergent;
+            if (listed++ < MAX_LISTED_DIVERGENCES)
+            {
+                printf("DIVERGED: %s: %u times, first at %us: displayed \"%s\", not \"%s\"\n",
+                       description, result->divergences, result->firstDivergenceAt,
+                       result->displayed, result->expected);
+            }
+        }
+    }
+
+    if (!finished)
+        return;
+
+    printf("Finished: %u of %u\n", finished, count);
+    printf("Charge: %.3f mAh/day average, %.3f mAh/day at most\n",
+           totalCharge / 1000 / days / finished, maxCharge / 1000 / days);
+    printf("Wakeups (from power down): %.1f/day average\n", totalWakeups / days / finished);
+    printf("I2C: %.1f transactions/day, %.1f bytes/day average\n",
+           totalTransactions / days / finished, totalBytes / days / finished);
+    printf("Display checks: %llu, diverged in %u scenarios\n", (unsigned long long)totalChecks,
+           divergent);
+
+    //The average charge for each timeout, since it matters most
+    for (uint8_t t = 0; t < lengthOf(timeouts); ++t)
+    {
+        double charge = 0;
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (results[i].finished && (scenarios[i].timeout == timeouts[t]))
+            {
+                charge += results[i].charge;
+                ++n;
+            }
+        }
+
+        if (n)
+            printf("  timeout %2u: %.3f mAh/day average\n", timeouts[t], charge / 1000 / days / n);
+    }
+}
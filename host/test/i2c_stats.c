@@ -0,0 +1,274 @@
+/* I2C statistics tests
+ * By: John Jekel
+ *
+ * Checks the optional I2C_STATS counters and transaction trace (see i2c.h) against the HAL's own
+ * I2C totals, and leaving the hidden STATS mode that shows them (it only exists in builds with
+ * some instrumentation). Built against a copy of the firmware with I2C_STATS defined.
+ * Returns nonzero if any check fails.
+*/
+
+#include "hal.h"
+#include "ds3231.h"
+#include "hd44780.h"
+#include "system.h"
+
+#include "i2c.h"
+#include "lcd.h"
+#include "rtc.h"
+#include "scheduler.h"
+#include "settings.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+/* Constants/Macros */
+
+#define CHECK(condition) do \
+{ \
+    if (!(condition)) \
+    { \
+        printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+        ++failures; \
+    } \
+} while (0)
+
+#define MISSING_ADDRESS 0x50//Nothing is attached here
+
+#define SECOND SYSTEM_CYCLES_PER_SECOND
+#define MS SYSTEM_CYCLES_PER_MS
+
+/* Static Variables */
+
+static uint32_t failures;
+
+static const PROGMEM LCD_cgram_t glyphs =
+{
+    {0b11111, 0b10001, 0b10001, 0b10001, 0b10001, 0b10001, 0b10001, 0b11111},
+};
+
+/* Static Function Declarations */
+
+static void testCounters();
+static void testTrace();
+static void testNACK();
+static void testPages();
+static void testStatsTimeout();
+
+static void boot();
+static uint32_t sumTransactions();
+static uint32_t sumBytes();
+
+int main()
+{
+    testCounters();
+    testTrace();
+    testNACK();
+    testPages();
+    testStatsTimeout();//Boots the whole firmware, so it has to be last
+
+    if (failures)
+        printf("%u check(s) failed\n", (unsigned)failures);
+    else
+        printf("All checks passed\n");
+
+    return failures ? 1 : 0;
+}
+
+/* Static Functions */
+
+static void boot()//The parts of main() the tests need
+{
+    HAL_reset();
+    DS3231_attach();
+    HD44780_attach();
+
+    PRR = 0b01111111;
+    SMCR = 0b00000101;
+    SCHEDULER_init();
+    I2C_init();
+    RTC_invalidateAll();//The RTC was just replaced
+    I2C_initStats();
+    LCD_setCGRAM_P(glyphs);
+    sei();
+}
+
+static uint32_t sumTransactions()
+{
+    uint32_t sum = 0;
+    for (uint8_t i = 0; i < I2C_STATS_DEVICES; ++i)
+        sum += I2C_getStats(i)->transactions;
+    return sum;
+}
+
+static uint32_t sumBytes()
+{
+    uint32_t sum = 0;
+    for (uint8_t i = 0; i < I2C_STATS_DEVICES; ++i)
+        sum += I2C_getStats(i)->bytes;
+    return sum;
+}
+
+static void testCounters()
+{
+    boot();
+
+    //Both the asynchronous and the convenience paths agree with what the HAL saw on the bus
+    RTC_refreshAll();
+    LCD_init();
+    LCD_clear();
+    LCD_print("Hello");
+    LCD_flush();
+    I2C_beginTransfer(RTC_ADDRESS, 0);
+    I2C_sendByte(0x0E);
+    I2C_endTransfer();
+    I2C_waitUntilIdle();
+
+    const HAL_stats_t* hal = HAL_getStats();
+    CHECK(sumTransactions() == hal->i2cTransactions);
+    CHECK(sumBytes() == hal->i2cBytes);
+
+    const I2C_stats_t* rtc = I2C_getStats(I2C_STATS_RTC);
+    CHECK(rtc->transactions == 2);
+    CHECK(rtc->bytes == (1 + 1 + 1 + 19) + (1 + 1));//Write the pointer, repeated start, read
+    CHECK(rtc->nacks == 0);
+    CHECK(rtc->waitCycles > 0);//RTC_refreshAll sleeps until the registers arrive
+
+    const I2C_stats_t* lcd = I2C_getStats(I2C_STATS_LCD);
+    CHECK(lcd->transactions > 0);
+    CHECK(lcd->nacks == 0);
+    CHECK(I2C_getStats(I2C_STATS_EEPROM)->transactions == 0);
+    CHECK(I2C_getStats(I2C_STATS_OTHER)->transactions == 0);
+
+    //I2C_initStats starts over
+    I2C_initStats();
+    CHECK(sumTransactions() == 0);
+    CHECK(I2C_getTraceEntry(0) == NULL);
+}
+
+static void testTrace()
+{
+    boot();
+
+    RTC_refreshTime();
+    RTC_refreshControl();
+    I2C_waitUntilIdle();
+
+    //Most recent first
+    const I2C_traceEntry_t* control = I2C_getTraceEntry(0);
+    const I2C_traceEntry_t* time = I2C_getTraceEntry(1);
+    CHECK(control && time && !I2C_getTraceEntry(2));
+    if (!control || !time)
+        return;
+
+    CHECK(control->address == RTC_ADDRESS);
+    CHECK(control->length == 4);
+    CHECK(control->status == I2C_STATUS_DATA_READ_NACK);
+    CHECK(time->length == 6);
+    CHECK(time->timestamp < control->timestamp);
+
+    //Only the last I2C_TRACE_LENGTH transactions are kept
+    for (uint8_t i = 0; i < I2C_TRACE_LENGTH; ++i)
+    {
+        RTC_invalidateVolatile();//Else the day is only read once
+        RTC_refreshDay();
+    }
+    I2C_waitUntilIdle();
+
+    CHECK(I2C_getTraceEntry(I2C_TRACE_LENGTH) == NULL);
+    CHECK(I2C_getTraceEntry(I2C_TRACE_LENGTH - 1)->length == 4);
+    for (uint8_t i = 1; i < I2C_TRACE_LENGTH; ++i)
+        CHECK(I2C_getTraceEntry(i)->timestamp < I2C_getTraceEntry(i - 1)->timestamp);
+}
+
+static void testNACK()
+{
+    boot();
+
+    //A convenience transfer to nobody
+    I2C_beginTransfer(MISSING_ADDRESS, 0);
+    I2C_endTransfer();
+
+    //An asynchronous one (the ISR gives up after the address)
+    static const uint8_t data[2] = {0x12, 0x34};
+    I2C_transaction_t transaction = {.address = MISSING_ADDRESS, .writeBuffer = data,
+                                     .writeCount = sizeof(data)};
+    I2C_submit(&transaction);
+    I2C_waitForTransaction(&transaction);
+    I2C_waitUntilIdle();
+
+    const I2C_stats_t* other = I2C_getStats(I2C_STATS_OTHER);
+    CHECK(other->transactions == 2);
+    CHECK(other->nacks == 2);
+    CHECK(other->bytes == 2);//Just the address bytes
+    CHECK(I2C_getTraceEntry(0)->address == MISSING_ADDRESS);
+    CHECK(I2C_getTraceEntry(0)->status == I2C_STATUS_ADDRESS_WRITE_NACK);
+    CHECK(I2C_getTraceEntry(1)->length == 1);
+}
+
+static void testPages()
+{
+    boot();
+
+    char line[17];
+
+    LCD_init();
+    RTC_refreshTime();
+    I2C_waitUntilIdle();
+    uint32_t rtcTransactions = I2C_getStats(I2C_STATS_RTC)->transactions;
+
+    //Device pages come first (two each), then the trace from the most recent transaction
+    I2C_drawPage(0);//Takes the snapshot the other pages show
+    I2C_drawPage(2);
+    LCD_flush();
+    I2C_waitUntilIdle();
+    HD44780_getLine(0, line);
+    CHECK(!strncmp(line, "RTC txn", 7));
+    char expected[17];
+    snprintf(expected, sizeof(expected), "%9u", (unsigned)rtcTransactions);
+    CHECK(!strcmp(line + 7, expected));
+
+    //The snapshot was taken before the page was flushed, so that's not in it
+    I2C_drawPage(I2C_STATS_DEVICES * 2);
+    LCD_flush();
+    I2C_waitUntilIdle();
+    HD44780_getLine(0, line);
+    CHECK(!strcmp(line, "#0 A68 L  6 S0B "));
+    HD44780_getLine(1, line);
+    CHECK(line[0] == '@');
+    CHECK(line[15] == 'c');
+}
+
+static void testStatsTimeout()
+{
+    //Thursday 2023-06-15 12:00:00
+    static const uint8_t startTime[7] = {0x00, 0x00, 0x12, 0x04, 0x15, 0x06, 0x23};
+    SYSTEM_boot(startTime);
+    SYSTEM_runUntil(1 * SECOND);
+    SETTINGS_data.clockTimeout = 3;
+
+    //CLOCK, then the MENU, then LEFT + RIGHT open the hidden STATS mode
+    SYSTEM_runUntil((1 * SECOND) + (600 * MS));
+    SYSTEM_press(SYSTEM_ENTER, 100 * MS);
+    SYSTEM_runUntil((2 * SECOND) + (600 * MS));
+    SYSTEM_press(SYSTEM_LEFT | SYSTEM_RIGHT, 100 * MS);
+    SYSTEM_runUntil((2 * SECOND) + (900 * MS));
+
+    char line[17];
+    HD44780_getLine(0, line);
+    CHECK(!strncmp(line + 3, " txn", 4));//The first device page
+
+    //The RTC interrupt that times out STATS enters CLOCK, which reads the time itself; the same
+    //interrupt mustn't advance it again
+    SYSTEM_runUntil((7 * SECOND) + (900 * MS));
+    HD44780_getLine(0, line);
+    CHECK(!strncmp(line + 1, "12:00:", 6));//Back in CLOCK
+    CHECK(RTC_data[0x0] == DS3231_getRegisters()[0x0]);
+
+    SYSTEM_runUntil((8 * SECOND) + (900 * MS));
+    CHECK(RTC_data[0x0] == DS3231_getRegisters()[0x0]);
+}
@@ -0,0 +1,673 @@
+/* Unit tests
+ * By: John Jekel
+ *
+ * Runs firmware modules on the host (see hal.h) against the DS3231 and HD44780 models.
+ * Returns nonzero if any check fails.
+*/
+
+#include "hal.h"
+#include "ds3231.h"
+#include "hd44780.h"
+
+#include "eeprom.h"
+#include "i2c.h"
+#include "lcd.h"
+#include "rtc.h"
+#include "scheduler.h"
+#include "settings.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+/* Constants/Macros */
+
+#define CHECK(condition) do \
+{ \
+    if (!(condition)) \
+    { \
+        printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+        ++failures; \
+    } \
+} while (0)
+
+#define CYCLES_PER_TICK (HAL_CYCLES_PER_MS * SCHEDULER_TICK_MS)
+
+/* Static Variables */
+
+static uint32_t failures;
+
+static uint64_t oneShotFiredAt;
+static uint8_t oneShotCount;
+static uint8_t periodicCount;
+
+static const PROGMEM LCD_cgram_t glyphs =
+{
+    {0b11111, 0b10001, 0b10001, 0b10001, 0b10001, 0b10001, 0b10001, 0b11111},
+    {0b00100, 0b01110, 0b11111, 0b00100, 0b00100, 0b00100, 0b00100, 0b00100},
+};
+
+/* Static Function Declarations */
+
+static void boot(bool withLCD);
+static void sleepUntilTick();
+static void setModelTime(uint8_t hours, uint8_t day, uint8_t date, uint8_t month, uint8_t year);
+
+static void testRTCTick();
+static void testRTCSync();
+static void testRTCSend();
+static void testRTCTracking();
+static void testRTCDatetime();
+static void testLCD();
+static void testLCDMissing();
+static void testI2CTimeout();
+static void testSettings();
+static void testScheduler();
+
+static void oneShot();
+static void periodic();
+
+/* Functions */
+
+int main()
+{
+    testRTCTick();
+    testRTCSync();
+    testRTCSend();
+    testRTCTracking();
+    testRTCDatetime();
+    testLCD();
+    testLCDMissing();
+    testI2CTimeout();
+    testSettings();
+    testScheduler();
+
+    if (failures)
+        printf("%u check(s) failed\n", (unsigned)failures);
+    else
+        printf("All checks passed\n");
+
+    return failures ? 1 : 0;
+}
+
+/* Static Functions */
+
+static void boot(bool withLCD)//The parts of main() the tests need (or with the LCD unplugged)
+{
+    HAL_reset();
+    DS3231_attach();
+    if (withLCD)
+        HD44780_attach();
+
+    PRR = 0b01111111;
+    SMCR = 0b00000101;
+    SCHEDULER_init();
+    I2C_init();
+    RTC_invalidateAll();//The RTC was just replaced
+    sei();
+}
+
+static void sleepUntilTick()//Like the UI's sleep loop, without the UI
+{
+    cli();
+    while (!SCHEDULER_isPending())
+    {
+        sei();
+        sleep_cpu();
+        cli();
+    }
+    sei();
+
+    SCHEDULER_run();
+}
+
+static void setModelTime(uint8_t hours, uint8_t day, uint8_t date, uint8_t month, uint8_t year)
+{
+    uint8_t* registers = DS3231_getRegisters();
+    registers[0x0] = 0x59;
+    registers[0x1] = 0x59;
+    registers[0x2] = hours;
+    registers[0x3] = day;
+    registers[0x4] = date;
+    registers[0x5] = month;
+    registers[0x6] = year;
+}
+
+//RTC
+
+static void testRTCTick()
+{
+    boot(true);
+
+    //End of the century
+    setModelTime(0x23, 0x07, 0x31, 0x12, 0x99);
+    RTC_sync();
+    CHECK(RTC_data[0x0] == 0x59);
+    CHECK(RTC_data[0x6] == 0x99);
+    RTC_tick();
+    CHECK(RTC_data[0x0] == 0x00);
+    CHECK(RTC_data[0x1] == 0x00);
+    CHECK(RTC_data[0x2] == 0x00);
+    CHECK(RTC_data[0x3] == 0x01);
+    CHECK(RTC_data[0x4] == 0x01);
+    CHECK(RTC_data[0x5] == 0x81);//Century bit flipped
+    CHECK(RTC_data[0x6] == 0x00);
+
+    //Leap year
+    setModelTime(0x23, 0x03, 0x28, 0x02, 0x24);
+    RTC_sync();
+    RTC_tick();
+    CHECK(RTC_data[0x4] == 0x29);
+    CHECK(RTC_data[0x5] == 0x02);
+
+    //Not a leap year
+    setModelTime(0x23, 0x02, 0x28, 0x02, 0x23);
+    RTC_sync();
+    RTC_tick();
+    CHECK(RTC_data[0x4] == 0x01);
+    CHECK(RTC_data[0x5] == 0x03);
+
+    //30 day month, and the hour only rolling over
+    setModelTime(0x23, 0x01, 0x30, 0x04, 0x23);
+    RTC_sync();
+    RTC_tick();
+    CHECK(RTC_data[0x4] == 0x01);
+    CHECK(RTC_data[0x5] == 0x05);
+    setModelTime(0x09, 0x01, 0x15, 0x04, 0x23);
+    RTC_sync();
+    RTC_tick();
+    CHECK(RTC_data[0x2] == 0x10);
+    CHECK(RTC_data[0x4] == 0x15);
+}
+
+static void testRTCSync()
+{
+    boot(true);
+
+    setModelTime(0x12, 0x01, 0x15, 0x04, 0x23);
+    DS3231_getRegisters()[0x1] = 0x00;
+    RTC_sync();
+
+    //The software time drifts from the RTC's until the next sync
+    DS3231_getRegisters()[0x2] = 0x13;
+    for (uint8_t i = 1; i < RTC_SYNC_INTERVAL; ++i)
+    {
+        RTC_tickMinute();
+        CHECK(RTC_data[0x2] == 0x12);
+    }
+
+    uint32_t transactions = HAL_getStats()->i2cTransactions;
+    RTC_tickMinute();
+    CHECK(HAL_getStats()->i2cTransactions == (transactions + 1));
+    CHECK(RTC_data[0x2] == 0x13);
+}
+
+static void testRTCSend()
+{
+    boot(true);
+
+    RTC_refreshAll();
+    CHECK(RTC_data[0xE] == 0b00011100);//Power on default
+
+    RTC_data[0x1] = 0x42;
+    RTC_data[0x2] = 0x17;
+    RTC_sendTime();
+    RTC_data[0xE] = 0b00000010;
+    RTC_sendControl();
+    RTC_commit();
+    I2C_waitUntilIdle();
+
+    const uint8_t* registers = DS3231_getRegisters();
+    CHECK(registers[0x1] == 0x42);
+    CHECK(registers[0x2] == 0x17);
+    CHECK(registers[0xE] == 0b00000010);
+
+    //The 1hz square wave is now on INT0 and the seconds register was reset with the time
+    HAL_runFor(F_CPU / 4);
+    CHECK(HAL_getPIND() & (1 << 2));
+    HAL_runFor(F_CPU / 2);
+    CHECK(!(HAL_getPIND() & (1 << 2)));
+    CHECK(DS3231_getSecondsElapsed() == 1);
+}
+
+static void testRTCTracking()
+{
+    boot(true);
+
+    const HAL_stats_t* stats = HAL_getStats();
+    uint8_t* registers = DS3231_getRegisters();
+
+    //A range already read isn't read again until it's invalidated (volatile ones once per wake)
+    RTC_refreshAll();
+    uint32_t transactions = stats->i2cTransactions;
+    RTC_refreshTime();
+    RTC_refreshA2();
+    CHECK(stats->i2cTransactions == transactions);
+
+    RTC_invalidateVolatile();
+    RTC_refreshA2();
+    CHECK(stats->i2cTransactions == transactions);
+    RTC_refreshTime();
+    CHECK(stats->i2cTransactions == (transactions + 1));
+
+    //Changes that weren't sent are read over
+    RTC_data[0xC] = 0x07;
+    RTC_refreshA2();
+    CHECK(stats->i2cTransactions == (transactions + 2));
+    CHECK(RTC_data[0xC] == 0x00);
+
+    //Nothing is written until RTC_commit, then adjacent ranges go out together
+    transactions = stats->i2cTransactions;
+    RTC_data[0x1] = 0x42;
+    RTC_data[0x2] = 0x17;
+    RTC_sendTime();
+    RTC_data[0x4] = 0x21;
+    RTC_sendDateAndDay();
+    I2C_waitUntilIdle();
+    CHECK(stats->i2cTransactions == transactions);
+    CHECK(registers[0x1] != 0x42);
+
+    uint32_t bytes = stats->i2cBytes;
+    RTC_commit();
+    I2C_waitUntilIdle();
+    CHECK(stats->i2cTransactions == (transactions + 1));
+    CHECK(stats->i2cBytes == (bytes + 2 + 6));//0x0 was read this wake and is unchanged
+    CHECK(registers[0x1] == 0x42);
+    CHECK(registers[0x4] == 0x21);
+
+    //Registers the RTC already holds aren't written again
+    RTC_registers.control.alarmsOnINT = 1;//Already set by default
+    RTC_sendControl();
+    RTC_commit();
+    I2C_waitUntilIdle();
+    CHECK(stats->i2cTransactions == (transactions + 1));
+
+    //A couple of unchanged alarm registers join two runs, but volatile ones never do
+    RTC_data[0xA] = 0x81;
+    RTC_data[0xD] = 0x81;
+    RTC_sendAlarms();
+    RTC_data[0xE] = 0b00000100;
+    RTC_data[0x10] = 0x05;
+    RTC_sendControl();
+    RTC_sendAging();
+    RTC_commit();
+    I2C_waitUntilIdle();
+    CHECK(stats->i2cTransactions == (transactions + 3));//0xA to 0xE, then 0x10
+    CHECK(registers[0xD] == 0x81);
+    CHECK(registers[0x10] == 0x05);
+
+    //Pending writes are sent before the range is read
+    RTC_registers.status.value = 0x00;
+    RTC_sendCSR();
+    registers[0xF] = 0x03;//Both alarm flags
+    RTC_invalidateVolatile();
+    RTC_refreshCSR();//What was just written is known, so it's not read
+    I2C_waitUntilIdle();
+    CHECK(registers[0xF] == 0x00);
+    CHECK(RTC_registers.status.value == 0x00);
+
+    //A send that fails (here, because SDA is stuck) leaves nothing known, so the next refresh
+    //reads what the RTC really has, even for registers that aren't volatile
+    uint8_t minutesA2 = registers[0xB];
+    RTC_data[0xB] = 0x45;
+    RTC_sendA2();
+    HAL_holdSDA(9);
+    RTC_commit();
+    RTC_invalidateVolatile();
+    CHECK(RTC_refreshA2() == I2C_OK);
+    CHECK(registers[0xB] == minutesA2);
+    CHECK(RTC_data[0xB] == minutesA2);
+
+    //Committing the same value again after a failed send still writes it
+    RTC_data[0xB] = 0x45;
+    RTC_sendA2();
+    HAL_holdSDA(9);
+    RTC_commit();
+    RTC_data[0xB] = 0x45;
+    RTC_sendA2();
+    RTC_commit();
+    I2C_waitUntilIdle();
+    CHECK(registers[0xB] == 0x45);
+}
+
+static void testRTCDatetime()
+{
+    boot(true);
+
+    //The named registers are the same bytes as the raw ones
+    setModelTime(0x23, 0x07, 0x31, 0x12, 0x99);
+    RTC_sync();
+    CHECK(RTC_registers.hours.tens == 2);
+    CHECK(RTC_registers.hours.units == 3);
+    CHECK(RTC_registers.day.day == 7);
+    CHECK(RTC_registers.control.value == RTC_data[0xE]);
+    RTC_registers.alarm2.date.mask = 1;
+    CHECK(RTC_data[0xD] & 0x80);
+    RTC_registers.control.alarm2Interrupt = 1;
+    CHECK(RTC_data[0xE] & (1 << 1));
+
+    //Decoded along with the registers, and when ticking
+    CHECK(RTC_now.hours == 23);
+    CHECK(RTC_now.minutes == 59);
+    CHECK(RTC_now.date == 31);
+    CHECK(RTC_now.month == 12);
+    CHECK(RTC_now.year == 99);
+    CHECK(!RTC_now.century);
+    RTC_tick();
+    CHECK(RTC_now.hours == 0);
+    CHECK(RTC_now.day == 1);
+    CHECK(RTC_now.date == 1);
+    CHECK(RTC_now.month == 1);
+    CHECK(RTC_now.year == 0);
+    CHECK(RTC_now.century);
+
+    //And when set digit by digit, then sent
+    RTC_registers.minutes.tens = 4;
+    RTC_registers.minutes.units = 2;
+    RTC_sendTime();
+    CHECK(RTC_now.minutes == 42);
+    RTC_commit();
+    I2C_waitUntilIdle();
+
+    //Conversions
+    CHECK(RTC_toBCD(0) == 0x00);
+    CHECK(RTC_toBCD(9) == 0x09);
+    CHECK(RTC_toBCD(10) == 0x10);
+    CHECK(RTC_toBCD(59) == 0x59);
+    CHECK(RTC_toBCD(99) == 0x99);
+    CHECK(RTC_fromBCD(RTC_registers.minutes) == 42);
+    CHECK(RTC_minuteOfDay(23, 59) == 1439);
+
+    RTC_datetime_t datetime = {.date = 1, .month = 1, .year = 0};
+    CHECK(RTC_dayOfCentury(&datetime) == 0);
+    datetime.month = 3;//After February 29th, 00
+    CHECK(RTC_dayOfCentury(&datetime) == 60);
+    datetime.year = 1;
+    datetime.month = 1;
+    CHECK(RTC_dayOfCentury(&datetime) == 366);
+    datetime.year = 24;
+    datetime.month = 12;
+    datetime.date = 31;
+    CHECK(RTC_dayOfCentury(&datetime) == 9131);//2024-12-31 is 9131 days after 2000-01-01
+}
+
+//LCD
+
+static void testLCD()
+{
+    boot(true);
+
+    char line[17];
+    uint64_t start = HAL_getCycles();
+
+    LCD_setCGRAM_P(glyphs);
+    LCD_init();
+    CHECK(HAL_getCycles() - start >= 15 * HAL_CYCLES_PER_MS);//Power up time
+    CHECK(HD44780_isDisplayOn());
+
+    LCD_clear();
+    LCD_setDisplayAddress(0x00);
+    LCD_print("Hello");
+    LCD_setDisplayAddress(0x40);
+    LCD_printNumber(1234, 6);
+    LCD_flush();
+    I2C_waitUntilIdle();
+
+    HD44780_getLine(0, line);
+    CHECK(!strcmp(line, "Hello           "));
+    HD44780_getLine(1, line);
+    CHECK(!strcmp(line, "  1234          "));
+    CHECK(!memcmp(HD44780_getGlyph(1), glyphs[1], 8));
+
+    //Only changed characters are sent, with address commands only for gaps
+    HD44780_clearStats();
+    LCD_setDisplayAddress(0x01);
+    LCD_print("ELLO");
+    LCD_flush();
+    I2C_waitUntilIdle();
+    CHECK(HD44780_getStats()->commands == 1);
+    CHECK(HD44780_getStats()->characters == 4);
+    CHECK(HD44780_getStats()->i2cBytes == (5 * 4));
+    HD44780_getLine(0, line);
+    CHECK(!strcmp(line, "HELLO           "));
+
+    //A one character gap is filled in instead of sending an address command
+    HD44780_clearStats();
+    LCD_setDisplayAddress(0x00);
+    LCD_print("J");
+    LCD_setDisplayAddress(0x02);
+    LCD_print("l");
+    LCD_flush();
+    I2C_waitUntilIdle();
+    CHECK(HD44780_getStats()->commands == 1);
+    CHECK(HD44780_getStats()->characters == 3);
+
+    //Nothing changed, so nothing is sent
+    HD44780_clearStats();
+    LCD_flush();
+    I2C_waitUntilIdle();
+    CHECK(HD44780_getStats()->i2cBytes == 0);
+
+    //Turning the module off and on again redraws everything
+    LCD_off();
+    CHECK(!HD44780_isPowered());
+    LCD_on();
+    LCD_flush();
+    I2C_waitUntilIdle();
+    CHECK(HD44780_isDisplayOn());
+    HD44780_getLine(0, line);
+    CHECK(!strcmp(line, "JElLO           "));
+    CHECK(!memcmp(HD44780_getGlyph(0), glyphs[0], 8));
+}
+
+static void testLCDMissing()
+{
+    boot(false);
+
+    //Nothing answers, so the module's power is cut and nothing more is sent to it
+    LCD_setCGRAM_P(glyphs);
+    CHECK(LCD_init() == I2C_NACK);
+    CHECK(HAL_getPORTB() & (1 << 2));
+
+    uint32_t transactions = HAL_getStats()->i2cTransactions;
+    LCD_print("Hello");
+    LCD_flush();
+    I2C_waitUntilIdle();
+    CHECK(HAL_getStats()->i2cTransactions == transactions);
+
+    //The RTC works the same without it
+    setModelTime(0x12, 0x01, 0x15, 0x04, 0x23);
+    CHECK(RTC_refreshTime() == I2C_OK);
+    CHECK(RTC_data[0x2] == 0x12);
+
+    //LCD_on looks for it again
+    CHECK(LCD_on() == I2C_NACK);
+    CHECK(HAL_getStats()->i2cTransactions == (transactions + 2));
+
+    //A transfer that never finishes (here, because SDA is stuck) is found by the next flush
+    boot(true);
+    CHECK(LCD_init() == I2C_OK);
+    LCD_clear();
+    LCD_setDisplayAddress(0);
+    LCD_flush();//Upload the glyphs first
+    HAL_holdSDA(9);
+    LCD_print("A");
+    LCD_flush();
+    LCD_print("B");
+    LCD_flush();
+    CHECK(HAL_getPORTB() & (1 << 2));
+
+    //Recovering the bus let go of SDA, so the module can be used again
+    CHECK(LCD_on() == I2C_OK);
+    LCD_flush();
+    I2C_waitUntilIdle();
+    char line[17];
+    HD44780_getLine(0, line);
+    CHECK(!strcmp(line, "AB              "));
+}
+
+//I2C
+
+static void testI2CTimeout()
+{
+    boot(true);
+
+    setModelTime(0x12, 0x01, 0x15, 0x04, 0x23);
+    RTC_data[0x2] = 0x07;
+
+    //A slave holding SDA low keeps the start bit from going out, so the read times out
+    HAL_holdSDA(3);
+    uint64_t start = HAL_getCycles();
+    CHECK(RTC_refreshTime() == I2C_TIMEOUT);
+    uint64_t waited = HAL_getCycles() - start;
+    CHECK(waited >= (I2C_TIMEOUT_MS * HAL_CYCLES_PER_MS));
+    CHECK(waited < (2 * I2C_TIMEOUT_MS * HAL_CYCLES_PER_MS));
+    CHECK(RTC_data[0x2] == 0x07);//Left alone
+
+    //The bus was recovered by clocking SCL, so the next read works
+    CHECK(HAL_peek(0x26) & (1 << 4));//PINC: SDA is high again
+    CHECK(RTC_refreshTime() == I2C_OK);
+    CHECK(RTC_data[0x2] == 0x12);
+
+    //A failed sync keeps counting in software and tries again a minute later
+    RTC_data[0x1] = 0x30;
+    HAL_holdSDA(3);
+    CHECK(RTC_sync() == I2C_TIMEOUT);
+    CHECK(RTC_data[0x1] == 0x30);
+    RTC_tickMinute();
+    CHECK(RTC_data[0x1] == 0x59);//From the RTC
+
+    //The convenience functions time out too
+    HAL_holdSDA(3);
+    CHECK(I2C_beginTransfer(RTC_ADDRESS, 0) == I2C_TIMEOUT);
+    I2C_endTransfer();
+    CHECK(I2C_beginTransfer(RTC_ADDRESS, 0) == I2C_OK);
+    CHECK(I2C_sendByte(0x00) == I2C_OK);
+    I2C_endTransfer();
+    CHECK(I2C_beginTransfer(0x50, 0) == I2C_NACK);
+    I2C_endTransfer();
+}
+
+//Settings
+
+static void testSettings()
+{
+    boot(true);
+
+    //Erased EEPROM, so the defaults are used and nothing is written
+    SETTINGS_load();
+    CHECK(SETTINGS_data.alarmEnabled == SETTINGS_DEFAULT_ALARM_ENABLED);
+    CHECK(SETTINGS_data.clockTimeout == SETTINGS_DEFAULT_CLOCK_TIMEOUT);
+    SETTINGS_save();
+    EEPROM_waitUntilIdle();
+    CHECK(HAL_getStats()->eepromWrites == 0);
+
+    //Save and load
+    SETTINGS_data.clockTimeout = 42;
+    SETTINGS_save();
+    EEPROM_waitUntilIdle();
+    CHECK(HAL_getStats()->eepromWrites);//Bytes that are already correct (eg. reserved) are skipped
+    CHECK(HAL_getStats()->eepromWrites <= SETTINGS_RECORD_SIZE);
+    SETTINGS_data.clockTimeout = 0;
+    SETTINGS_load();
+    CHECK(SETTINGS_data.clockTimeout == 42);
+
+    //The journal wraps around (several times)
+    for (uint16_t i = 0; i < 300; ++i)
+    {
+        SETTINGS_data.clockTimeout = (i % 99) + 1;
+        SETTINGS_save();
+    }
+    EEPROM_waitUntilIdle();
+    SETTINGS_data.clockTimeout = 0;
+    SETTINGS_load();
+    CHECK(SETTINGS_data.clockTimeout == ((299 % 99) + 1));
+
+    //A corrupted (eg. half written) newest record falls back to the one before it
+    HAL_reset();
+    sei();
+    SETTINGS_load();
+    SETTINGS_data.clockTimeout = 10;
+    SETTINGS_save();
+    SETTINGS_data.clockTimeout = 20;
+    SETTINGS_save();
+    EEPROM_waitUntilIdle();
+
+    uint8_t* eeprom = HAL_getEEPROM();
+    uint16_t newest = HAL_EEPROM_SIZE;
+    for (uint16_t address = 0; address < HAL_EEPROM_SIZE; address += SETTINGS_RECORD_SIZE)
+    {
+        if ((eeprom[address] != 0xFF) && (eeprom[address + 4] == 20))//clockTimeout
+            newest = address;
+    }
+    CHECK(newest != HAL_EEPROM_SIZE);
+    eeprom[newest + 4] = 21;
+
+    SETTINGS_load();
+    CHECK(SETTINGS_data.clockTimeout == 10);
+}
+
+//Scheduler
+
+static void testScheduler()
+{
+    boot(true);
+
+    static SCHEDULER_timer_t oneShotTimer = {.callback = oneShot};
+    static SCHEDULER_timer_t periodicTimer = {.callback = periodic};
+
+    oneShotCount = 0;
+    periodicCount = 0;
+    uint64_t start = HAL_getCycles();
+
+    SCHEDULER_start(&oneShotTimer, 100, 0);
+    SCHEDULER_start(&periodicTimer, 32, 32);
+
+    while (periodicCount < 9)
+        sleepUntilTick();
+
+    uint64_t elapsed = HAL_getCycles() - start;
+    CHECK(elapsed >= (uint64_t)CYCLES_PER_TICK * 288);
+    CHECK(elapsed < (uint64_t)CYCLES_PER_TICK * 289);
+    CHECK(oneShotCount == 1);
+    CHECK(oneShotFiredAt - start >= (uint64_t)CYCLES_PER_TICK * 100);
+    CHECK(oneShotFiredAt - start < (uint64_t)CYCLES_PER_TICK * 101);
+
+    //Tickless: about one wakeup per deadline instead of one per tick
+    CHECK(HAL_getStats()->wakeups <= 2 * (9 + 1));
+
+    //Stopped timers don't fire
+    SCHEDULER_stop(&periodicTimer);
+    HAL_runFor((uint64_t)CYCLES_PER_TICK * 100);
+    SCHEDULER_run();
+    CHECK(periodicCount == 9);
+
+    //Wakes from other interrupts (here every 20 ticks, like the 1hz interrupt) run the scheduler
+    //too, but mustn't hold back timers that are due after them
+    SCHEDULER_start(&periodicTimer, 64, 64);
+    start = HAL_getCycles();
+    while ((HAL_getCycles() - start) < ((uint64_t)CYCLES_PER_TICK * 64 * 5))
+    {
+        HAL_runFor((uint64_t)CYCLES_PER_TICK * 20);
+        SCHEDULER_run();
+    }
+    CHECK(periodicCount >= (9 + 4));
+    CHECK(periodicCount <= (9 + 5));
+    SCHEDULER_stop(&periodicTimer);
+}
+
+static void oneShot()
+{
+    oneShotFiredAt = HAL_getCycles();
+    ++oneShotCount;
+}
+
+static void periodic()
+{
+    ++periodicCount;
+}
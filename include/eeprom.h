@@ -2,15 +2,27 @@
  * By: John Jekel
  *
  * Allows for reading, writing, and swapping of the values in an atmega328p's internal EEPROM.
+ * Writes are queued and performed in the background by the EE_READY interrupt, so they return
+ * right away (unless the queue is full). Reads of addresses with queued writes return the
+ * queued data.
 */
 
 #ifndef EEPROM_H
 #define EEPROM_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
+/* Settings */
+
+#define EEPROM_QUEUE_LENGTH 8//Must be a power of 2
+
+/* Functions */
+
 uint8_t EEPROM_read(uint16_t address);
 void EEPROM_write(uint8_t data, uint16_t address);
 uint8_t EEPROM_swap(uint8_t data, uint16_t address);//Returns old data at address and writes new
+bool EEPROM_isBusy();//Returns true if writes are queued or in progress
+void EEPROM_waitUntilIdle();//Sleeps (idle mode) until all queued writes are finished
 
 #endif//EEPROM_H
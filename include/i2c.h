@@ -13,13 +13,17 @@
  * Functions used by both lower level and convenience functions
  * I2C_init                 Must be called before anything else (sets up I2C peripheral and pins)
  * I2C_TWINTIsSet           Returns true if the TWINT flag is set
- * I2C_busyWait             Blocks until the TWINT flag is set
+ * I2C_busyWait             Blocks until the TWINT flag is set; false if it timed out
+ * I2C_busyWaitStopBit      Blocks until the stop bit has been sent; false if it timed out
  * I2C_getStatus            Returns the 5bit status value of the I2C peripheral
+ * I2C_recoverBus           Gives up on everything queued, then clocks SCL by hand until a slave
+ *                          holding SDA low lets go, and sends a stop bit
  * 
  * Convenience Functions (Much much slower, but save lots of program space and easier to use)
  * I2C_beginTransfer        Begins a transfer to the specified I2C address. 0 is write, 1 is read
+ *                          Returns an I2C_result_t; if not I2C_OK, just call I2C_endTransfer
  * I2C_endTransfer          Stops an I2C transfer
- * I2C_sendByte             Sends a byte to an I2C slave
+ * I2C_sendByte             Sends a byte to an I2C slave. Returns an I2C_result_t
  * I2C_recieveByte          Reads a byte from an I2C slave (for all except last byte read)
  * I2C_recieveLastByte      Like I2C_recieveByte, but MUST be used for the last byte received
  * 
@@ -32,6 +36,38 @@
  * I2C_transferByteThenNACK Writes without ACK afterwards. Used when writing/reading last byte
  * I2C_transferAddress      Same as I2C_transferByteThenNACK, used after I2C_setAddressToTransfer
  * I2C_getByteRecieved      Returns byte read from slave after I2C_transferByteThenACK
+ * 
+ * Asynchronous Transactions (Recommended for power; the MCU can sleep while the bus is busy)
+ * I2C_submit               Queues a transaction. The TWI_vect ISR runs it in the background
+ * I2C_isIdle               Returns true if no transactions are queued or in progress
+ * I2C_waitForTransaction   Sleeps (idle mode) until the transaction is complete, then returns
+ *                          its result
+ * I2C_waitUntilIdle        Sleeps (idle mode) until every queued transaction is complete and the
+ *                          bus is released (so the peripheral can be disabled afterwards)
+ * NOTE: A transaction must not be modified or resubmitted until its complete flag is set.
+ * NOTE: A slave that NACKs ends the transaction right away (eg. if it isn't connected).
+ * 
+ * Timeouts
+ * Every wait gives up after I2C_TIMEOUT_MS (timed by timer 2; see timer.h), then recovers the bus
+ * with I2C_recoverBus. Every transaction that was queued then completes with I2C_TIMEOUT.
+ * NOTE: Must be called with interrupts enabled (the timeout is set by an ISR), and not during
+ *  TIMER_sleep (it needs timer 2 too).
+ * NOTE: The convenience and lower level functions must not be used while transactions are
+ *  queued. I2C_beginTransfer waits for the queue to empty first for this reason.
+ * 
+ * Statistics (Optional; define I2C_STATS, eg. with -DI2C_STATS=ON)
+ * Counts the transactions, bytes (including address bytes), NACKs and cycles spent waiting for
+ * the bus (busy-waiting or sleeping in idle mode) for each device, and keeps the last
+ * I2C_TRACE_LENGTH transactions in a ring buffer. Results are shown on the LCD by the hidden
+ * STATS mode. Timer 0 free-runs at F_CPU/8 while the MCU is awake to timestamp them.
+ * Only transactions from the convenience functions (ended by I2C_endTransfer) and asynchronous
+ * transactions are counted; the lower level functions are not instrumented.
+ * I2C_initStats            Call after I2C_init (resets the results)
+ * I2C_getStats             Returns the counters for a device (one of the I2C_STATS_* indexes)
+ * I2C_getTraceEntry        Returns a transaction from the ring buffer (0 is the most recent), or
+ *                          NULL if there haven't been that many yet
+ * NOTE: Can't be used with PROFILE or POWER_ACCOUNTING (they also need timer 0).
+ * Without I2C_STATS, I2C_initStats compiles to nothing.
 */
 
 #ifndef I2C_H
@@ -41,30 +77,115 @@
 
 /* Settings */
 
-#define I2C_FREQ 100000//In hz; only 100khz is supported
+//SCL frequency for each device in hz; applied whenever a transfer to that device begins
+//NOTE: Fast mode relies on the external pullups on the DS3231 module (the internal ones are
+//too weak for 400khz)
+#define I2C_FREQ_STANDARD   100000
+#define I2C_FREQ_FAST       400000
+#define I2C_FREQ_LCD        I2C_FREQ_FAST//PCF8574 LCD backpack (LCD_ADDRESS)
+#define I2C_FREQ_RTC        I2C_FREQ_FAST//DS3231 (RTC_ADDRESS)
+#define I2C_FREQ_EEPROM     I2C_FREQ_FAST//AT24C32 on the RTC module (I2C_EEPROM_ADDRESS)
+#define I2C_FREQ_DEFAULT    I2C_FREQ_STANDARD//Any other address
+
+#define I2C_EEPROM_ADDRESS 0x57
+
+//Longest any wait for the bus may take before giving up. Must be longer than everything that can
+//be queued at once takes to send (a full LCD_flush takes ~3ms at 400khz), and at most
+//TIMER_MAX_TIMEOUT_TICKS long
+#define I2C_TIMEOUT_MS 16
+
+#define I2C_TRACE_LENGTH 8//Transactions kept by I2C_STATS
 
 /* Public Functions and Macros */
 
+#include "power.h"
+
 #include <avr/io.h>
 #include <stdbool.h>
 #include <stdint.h>
 
+/* Typedefs */
+
+typedef enum
+{
+    I2C_OK,
+    I2C_NACK,//The slave didn't acknowledge its address or a written byte
+    I2C_ARBITRATION_LOST,
+    I2C_TIMEOUT//The bus didn't respond within I2C_TIMEOUT_MS and was recovered
+} I2C_result_t;
+
+typedef struct I2C_transaction
+{
+    struct I2C_transaction* next;//Used internally by the queue
+    uint8_t address;//7 bit address of the slave
+    uint8_t flags;//I2C_WRITE_FROM_PROGMEM or 0
+    const uint8_t* writeBuffer;//Bytes sent after the address (with the write bit)
+    uint8_t writeCount;//If 0, the transaction begins by reading
+    uint8_t* readBuffer;//Bytes read after a repeated start (or after the start if writeCount == 0)
+    uint8_t readCount;//If 0, the transaction ends after writing
+    volatile bool complete;//Set by the ISR when the stop bit is sent
+    volatile uint8_t result;//I2C_result_t; valid once complete is set
+} I2C_transaction_t;
+
+#define I2C_WRITE_FROM_PROGMEM 0b00000001//writeBuffer points to program space
+
+typedef struct//Totals since I2C_initStats, for one device
+{
+    uint32_t transactions;
+    uint32_t bytes;//Including address bytes
+    uint16_t nacks;//Address or written byte NACKed by the slave (the transaction was abandoned)
+    uint32_t waitCycles;//Time the CPU spent waiting for the bus
+} I2C_stats_t;
+
+typedef struct//One transaction in the ring buffer
+{
+    uint32_t timestamp;//Awake cycles since I2C_initStats when the start bit was sent
+    uint8_t address;//7 bit address of the slave
+    uint8_t length;//Bytes transferred, including address bytes
+    uint8_t status;//I2C_getStatus() just before the stop bit
+} I2C_traceEntry_t;
+
+//Indexes for I2C_getStats
+#define I2C_STATS_LCD 0
+#define I2C_STATS_RTC 1
+#define I2C_STATS_EEPROM 2
+#define I2C_STATS_OTHER 3//Any other address
+#define I2C_STATS_DEVICES 4
+
 //Common
 void I2C_init();
 #define I2C_TWINTIsSet() (TWCR >> 7)
-#define I2C_busyWait() while (!I2C_TWINTIsSet())//Wait for TWINT to be set
-#define I2C_busyWaitStopBit() while (TWCR & (1 << 4))//Wait for TWSTO to clear
+bool I2C_busyWait();//Wait for TWINT to be set
+bool I2C_busyWaitStopBit();//Wait for TWSTO to clear
 #define I2C_getStatus() (TWSR >> 3)
-#define I2C_peripheralEnable() do {PRR &= ~(1 << 7);} while (0)
-#define I2C_peripheralDisable() do {PRR |= 1 << 7;} while (0)
+void I2C_recoverBus();
+#define I2C_peripheralEnable() do {PRR &= ~(1 << 7); POWER_accountOn(POWER_I2C);} while (0)
+#define I2C_peripheralDisable() do {PRR |= 1 << 7; POWER_accountOff(POWER_I2C);} while (0)
 
 //Convenience Functions (Much much slower, but can save program space and are easier to use)
-#define I2C_beginTransfer(addr, rd) do {I2C_rawTransfer(((addr) << 1) | ((rd) ? 1 : 0));}while(0)
+#define I2C_beginTransfer(addr, rd) (I2C_rawTransfer(((addr) << 1) | ((rd) ? 1 : 0)))
 void I2C_endTransfer();
-void I2C_sendByte(uint8_t byte);//NOTE: Use this for all written bytes, including the last
+I2C_result_t I2C_sendByte(uint8_t byte);//NOTE: Use this for all written bytes, including the last
 uint8_t I2C_recieveByte();
 uint8_t I2C_recieveLastByte();//NOTE: recieveLastByte MUST be used for the last byte received
 
+//Asynchronous Transactions (Interrupt driven; the MCU can sleep while they're in progress)
+void I2C_submit(I2C_transaction_t* transaction);
+bool I2C_isIdle();
+I2C_result_t I2C_waitForTransaction(const I2C_transaction_t* transaction);
+void I2C_waitUntilIdle();
+
+//Statistics (only with I2C_STATS)
+#ifdef I2C_STATS
+void I2C_initStats();
+const I2C_stats_t* I2C_getStats(uint8_t device);
+const I2C_traceEntry_t* I2C_getTraceEntry(uint8_t age);
+uint8_t I2C_getPageCount();
+void I2C_drawPage(uint8_t page);//Draws one page of results to the LCD
+#else
+#define I2C_initStats() do {} while (0)
+#endif
+
 //Low Level Control (Recommended for speed)
 #define I2C_sendStartBit() do {TWCR = I2C_START_BIT_COMMAND;} while (0)
 #define I2C_sendStopBit() do {TWCR = I2C_STOP_BIT_COMMAND;} while (0)
@@ -82,7 +203,34 @@ uint8_t I2C_recieveLastByte();//NOTE: recieveLastByte MUST be used for the last
 #define I2C_STOP_BIT_COMMAND       0b10010100//Clear TWINT, set TWSTO (stop bit), keep I2C on
 #define I2C_TRANSFER_ACK_COMMAND   0b11000100//Clear TWINT, set TWEA (send ACK), keep I2C on 
 #define I2C_TRANSFER_NACK_COMMAND  0b10000100//Clear TWINT, send NACK, keep I2C on
+//Same as above, but with TWIE set so that TWI_vect fires when TWINT is set
+#define I2C_ASYNC_START_BIT_COMMAND     0b10100101
+#define I2C_ASYNC_STOP_START_COMMAND    0b10110101//Stop bit followed by a start bit
+#define I2C_ASYNC_TRANSFER_ACK_COMMAND  0b11000101
+#define I2C_ASYNC_TRANSFER_NACK_COMMAND 0b10000101
+
+//Values returned by I2C_getStatus (master modes only)
+#define I2C_STATUS_START                0x01//Start bit sent
+#define I2C_STATUS_REPEATED_START       0x02//Repeated start bit sent
+#define I2C_STATUS_ADDRESS_WRITE_ACK    0x03//SLA+W sent, ACK received
+#define I2C_STATUS_ADDRESS_WRITE_NACK   0x04//SLA+W sent, NACK received
+#define I2C_STATUS_DATA_WRITE_ACK       0x05//Data sent, ACK received
+#define I2C_STATUS_DATA_WRITE_NACK      0x06//Data sent, NACK received
+#define I2C_STATUS_ARBITRATION_LOST     0x07
+#define I2C_STATUS_ADDRESS_READ_ACK     0x08//SLA+R sent, ACK received
+#define I2C_STATUS_ADDRESS_READ_NACK    0x09//SLA+R sent, NACK received
+#define I2C_STATUS_DATA_READ_ACK        0x0A//Data received, ACK returned
+#define I2C_STATUS_DATA_READ_NACK       0x0B//Data received, NACK returned
+
+I2C_result_t I2C_rawTransfer(uint8_t addressAndRWBit);//Sends start bit, address and r/w bit
 
-void I2C_rawTransfer(uint8_t addressAndRWBit);//Sends start bit, address and r/w bit
+//Bit rate register values for a given SCL frequency, computed at compile time
+//SCL frequency = F_CPU / (16 + (2 * TWBR * prescaler)); See datasheet page 221/222
+#define I2C_TWBR_FOR_PRESCALER(freq, prescaler) ((((F_CPU) / (freq)) - 16) / (2 * (prescaler)))
+#define I2C_TWPS(freq) \
+    ((I2C_TWBR_FOR_PRESCALER(freq, 1) <= 255) ? 0 : \
+     (I2C_TWBR_FOR_PRESCALER(freq, 4) <= 255) ? 1 : \
+     (I2C_TWBR_FOR_PRESCALER(freq, 16) <= 255) ? 2 : 3)
+#define I2C_TWBR(freq) (I2C_TWBR_FOR_PRESCALER(freq, 1 << (2 * I2C_TWPS(freq))))
 
 #endif//I2C_H
@@ -4,6 +4,15 @@
 
 #define LCD_ADDRESS 0x27
 
+/* Settings */
+
+//If 1, LCD_off cuts power to the module (lowest current, but LCD_on must then reinitialize it
+//and upload the CGRAM, taking ~20ms). If 0, the module is put into standby instead (display and
+//backlight off) and LCD_on resumes it with a single command.
+#define LCD_CUT_POWER_WHEN_OFF 1
+
+#include "i2c.h"
+
 #include <stdbool.h>
 #include <stdint.h>
 #include <avr/pgmspace.h>
@@ -15,19 +24,24 @@ typedef LCD_bitmap_t LCD_cgram_t[8];
 
 /* Functions */
 
-void LCD_setCGRAM_P(const LCD_cgram_t cgram);//Pointer to a LCD_cgram_t type
-void LCD_init();
-#define LCD_on() do {LCD_init();} while (0)//Calls LCD_init and enables backlight
-void LCD_off();//Turns of LCD NPN transistor to turn module off
-void LCD_clear();
+void LCD_setCGRAM_P(const LCD_cgram_t cgram);//Pointer to a LCD_cgram_t type; only changed glyphs are uploaded
+//If the module doesn't answer (eg. it's unplugged), or a later transfer to it fails, its power is
+//cut and nothing more is sent to it (the display counts as off) until LCD_on finds it again
+I2C_result_t LCD_init();//Full initialization from power up
+I2C_result_t LCD_on();//Enables the display and backlight, calling LCD_init if the module lost power
+void LCD_off();//Turns off the module (or puts it into standby; see LCD_CUT_POWER_WHEN_OFF)
 #define LCD_setCGRAMAddress(address) do {LCD_sendCommand(0b01000000 | (address));} while (0)
-#define LCD_setDisplayAddress(address) do {LCD_sendCommand(0b10000000 | (address));} while (0)
 
+//Drawing only writes to a shadow buffer; nothing is sent to the display until LCD_flush
+void LCD_clear();//Fills the shadow buffer with spaces
+void LCD_setDisplayAddress(uint8_t address);//0x00 to 0x0F is the first line, 0x40 to 0x4F second
 void LCD_writeCharacter(char character);
 void LCD_print(const char* string);
 void LCD_print_P(PGM_P string);//String in program space (eg. PSTR("Hello World!"))
 void LCD_printAmount(const char* string, uint8_t n);
 void LCD_printAmount_P(PGM_P string, uint8_t n);//String in program space (eg. PSTR("Hello World!"))
+void LCD_printNumber(uint32_t number, uint8_t width);//Decimal, right aligned to width characters
+void LCD_flush();//Sends only the characters that changed since the last flush (one I2C transaction)
 
 /* Internal Functions/Macros */
 
@@ -0,0 +1,67 @@
+/* Power management code
+ * By: John Jekel
+ *
+ * Sleep helpers shared by the drivers.
+ * 
+ * Optionally (define POWER_ACCOUNTING, eg. with -DPOWER_ACCOUNTING=ON) also keeps track of how
+ * long the clock spends in each power state (CPU sleep mode and which parts are powered), and
+ * estimates the average current and mAh per day from the POWER_CURRENT_* table below.
+ * Timer 0 (F_CPU/1024) measures the time the CPU clock runs (active and idle). It stops in power
+ * down, so that time is instead found from a periodic scheduler timer: whatever the watchdog says
+ * has elapsed but timer 0 didn't see was spent in power down.
+ * 
+ * NOTE: The watchdog oscillator is only accurate to about 10%, which limits the power down
+ *  times (and so the estimate).
+ * NOTE: Power down time is charged to the state of the most recent power down sleep, so a change
+ *  of state between sleeps may be charged up to one POWER_ACCOUNTING_PERIOD late.
+ * NOTE: Can't be used with PROFILE (both need timer 0).
+*/
+
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Constants/Macros */
+
+//Power state bits (parts that are powered)
+#define POWER_LCD 0b001//Display module (and backlight)
+#define POWER_BUZZER 0b010//Timer 1 driving the buzzer
+#define POWER_I2C 0b100//TWI peripheral clock
+
+//Current (in uA) drawn in each CPU state, plus each part that is powered (at 5v)
+#define POWER_CURRENT_ACTIVE 9500
+#define POWER_CURRENT_IDLE 3000
+#define POWER_CURRENT_POWER_DOWN 5//With the BOD disabled and the watchdog running
+#define POWER_CURRENT_ALWAYS 200//DS3231, pullups, etc.
+#define POWER_CURRENT_LCD 20000
+#define POWER_CURRENT_BUZZER 15000
+#define POWER_CURRENT_I2C 100
+
+#define POWER_ACCOUNTING_PERIOD 512//Scheduler ticks between power down updates (the maximum)
+
+/* Functions */
+
+//Sleeps in idle mode until an ISR sets *flag (or *otherFlag)
+#define POWER_idleUntil(flag) do {POWER_idleUntilEither((flag), (flag));} while (0)
+void POWER_idleUntilEither(const volatile bool* flag, const volatile bool* otherFlag);
+
+#ifdef POWER_ACCOUNTING
+void POWER_initAccounting();//Call after SCHEDULER_init
+void POWER_accountOn(uint8_t parts);//Call whenever one of the POWER_* parts is powered
+void POWER_accountOff(uint8_t parts);//Call whenever one of the POWER_* parts is unpowered
+void POWER_accountSleep();//Call with interrupts disabled, just before the sleep instruction
+void POWER_accountWake();//Call after the sleep instruction
+uint32_t POWER_getAverageCurrent();//In uA, since POWER_initAccounting
+uint8_t POWER_getPageCount();
+void POWER_drawPage(uint8_t page);//Draws one page of results to the LCD
+#else
+#define POWER_initAccounting() do {} while (0)
+#define POWER_accountOn(parts) do {} while (0)
+#define POWER_accountOff(parts) do {} while (0)
+#define POWER_accountSleep() do {} while (0)
+#define POWER_accountWake() do {} while (0)
+#endif
+
+#endif//POWER_H
@@ -0,0 +1,59 @@
+/* Profiling code
+ * By: John Jekel
+ *
+ * Optional (define PROFILE, eg. with -DPROFILE=ON) instrumentation of how long each wake takes.
+ * Timer 0 free-runs at F_CPU/8 while the MCU is awake and is stopped while it sleeps in power down
+ * (sleepUntilInterrupt in ui.c). It keeps counting through the idle mode sleeps of
+ * POWER_idleUntilEither (waiting for I2C, EEPROM or TIMER_sleep), so those count as awake time.
+ * Results are kept in RAM and shown on the LCD by the hidden STATS mode.
+ * 
+ * These phases are recorded:
+ *  Decide:      From ISR entry (or the end of the last event) until the UI picked the next mode
+ *  Setup M<n>:  The setup handler of mode n (mode_t in ui.c), including its RTC control write
+ *  Update M<n>: The update handler of mode n
+ * and these are also recorded for each wake/event as a whole:
+ *  Awake M<n>: From ISR entry until the sleep instruction, by the mode (mode_t in ui.c) at sleep
+ *  Event E<n>: From ISR entry (or the end of the last event) until the event was handled, by the
+ *              event source (wakeupReason_t in ui.c)
+ * 
+ * NOTE: The timer 0 overflow interrupt fires every 2048 cycles while awake, which adds a little
+ *  time to what is being measured.
+ * Without PROFILE, all of these compile to nothing.
+*/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+/* Constants/Macros */
+
+#define PROFILE_MODE_SLOTS 5//Must be at least MODE_COUNT in ui.c
+#define PROFILE_EVENT_SLOTS 3//Must be at least the number of wakeupReason_t values in ui.c
+#define PROFILE_HISTOGRAM_BUCKETS 8//Bucket n: under 1024 * 4^n cycles (the last: the rest)
+
+/* Functions */
+
+#ifdef PROFILE
+void PROFILE_init();
+void PROFILE_markWake();//Call first thing in ISRs that can wake the MCU from sleep
+void PROFILE_markDecided();
+void PROFILE_markHandlerStart();//Call just before a mode's setup or update handler
+void PROFILE_markSetupDone(uint8_t mode);
+void PROFILE_markUpdateDone(uint8_t mode);
+void PROFILE_markHandled(uint8_t eventType);
+void PROFILE_markSleep(uint8_t mode);//Call with interrupts disabled, just before sleeping
+uint8_t PROFILE_getPageCount();
+void PROFILE_drawPage(uint8_t page);//Draws one page of results to the LCD
+#else
+#define PROFILE_init() do {} while (0)
+#define PROFILE_markWake() do {} while (0)
+#define PROFILE_markDecided() do {} while (0)
+#define PROFILE_markHandlerStart() do {} while (0)
+#define PROFILE_markSetupDone(mode) do {} while (0)
+#define PROFILE_markUpdateDone(mode) do {} while (0)
+#define PROFILE_markHandled(eventType) do {} while (0)
+#define PROFILE_markSleep(mode) do {} while (0)
+#endif
+
+#endif//PROFILE_H
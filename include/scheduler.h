@@ -0,0 +1,52 @@
+/* Scheduler code
+ * By: John Jekel
+ *
+ * Software timers (one-shot and periodic callbacks) kept in a hierarchical timer wheel, driven by
+ * the watchdog timer interrupt. The watchdog keeps running in power down, so active timers never
+ * force a lighter sleep mode. (Timer 2 could only do that in power save if it were clocked from a
+ * 32khz crystal on TOSC1/2, but those pins are used by the main crystal.)
+ * 
+ * The scheduler is tickless: the watchdog only runs while timers are active, and its period is
+ * made as long as possible (16ms to 8s) without passing the next deadline, so there are no
+ * wakeups just to count ticks.
+ * 
+ * Callbacks are run by SCHEDULER_run from the main loop, never from the ISR.
+ * NOTE: The watchdog oscillator is only accurate to about 10%.
+ * NOTE: Starting a timer that is due before the current watchdog period ends restarts the period,
+ *  so other timers may be late by up to the part of the period that had already elapsed.
+*/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Constants/Macros */
+
+#define SCHEDULER_TICK_MS 16
+#define SCHEDULER_MS_TO_TICKS(ms) ((uint16_t)(((ms) + SCHEDULER_TICK_MS - 1) / SCHEDULER_TICK_MS))
+
+/* Typedefs */
+
+typedef struct SCHEDULER_timer
+{
+    void (*callback)();
+    
+    //Internal use only
+    struct SCHEDULER_timer* next;
+    uint16_t expiry;//Tick at which the timer fires
+    uint16_t period;//0 for one-shot timers
+    bool active;
+} SCHEDULER_timer_t;
+
+/* Functions */
+
+void SCHEDULER_init();
+void SCHEDULER_start(SCHEDULER_timer_t* timer, uint16_t delay, uint16_t period);//In ticks; delay >= 1
+void SCHEDULER_stop(SCHEDULER_timer_t* timer);
+void SCHEDULER_run();//Advances the wheel by the ticks that elapsed and runs expired callbacks
+bool SCHEDULER_isPending();//True if ticks have elapsed since the last SCHEDULER_run
+uint16_t SCHEDULER_getTick();//Ticks handled by SCHEDULER_run so far (wraps around)
+
+#endif//SCHEDULER_H
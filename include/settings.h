@@ -0,0 +1,46 @@
+/* Settings code
+ * By: John Jekel
+ *
+ * Keeps the persistent settings in RAM. They are loaded from the internal EEPROM once at boot
+ * (falling back to defaults if the EEPROM contents are invalid) and saved only when changed.
+ *
+ * EEPROM map
+ * The whole EEPROM is a journal of SETTINGS_RECORD_SIZE byte records, each holding every setting
+ * along with a sequence number and a CRC8. Each save appends a record after the newest one
+ * (wrapping around), so every cell is only written once per (EEPROM size / record size) saves.
+ * The newest valid record is found by scanning the journal at boot.
+*/
+
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Settings */
+
+#define SETTINGS_VERSION 2//Increment whenever SETTINGS_t changes so old contents are discarded
+#define SETTINGS_RECORD_SIZE 8//Bytes; must be a power of 2 and fit SETTINGS_t plus 4
+
+//Used when the EEPROM contents are invalid (ex. a factory-fresh chip, which reads all 0xFF)
+#define SETTINGS_DEFAULT_ALARM_ENABLED false
+#define SETTINGS_DEFAULT_CLOCK_TIMEOUT 5
+
+/* Typedefs */
+
+typedef struct
+{
+    bool alarmEnabled;
+    uint8_t clockTimeout;//Seconds (or minutes if CLOCK_MINUTE_RESOLUTION is enabled); 1 to 99
+} SETTINGS_t;
+
+/* Variables */
+
+extern SETTINGS_t SETTINGS_data;//Read and modify freely, then call SETTINGS_save
+
+/* Functions */
+
+void SETTINGS_load();//Call once at boot
+void SETTINGS_save();//Writes a new record if anything changed; combine changes into one save
+
+#endif//SETTINGS_H
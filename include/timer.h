@@ -0,0 +1,34 @@
+/* Timer code
+ * By: John Jekel
+ *
+ * Uses Timer 2 to wait for a period of time while sleeping (idle mode) instead of busy-waiting.
+ * It also provides timeouts: TIMER_startTimeout starts timer 2, and its interrupt sets
+ * TIMER_expired once the time is up, so the code waiting on something else can give up.
+ * NOTE: The resolution is 1024 CPU cycles (64us at 16MHz); waits are rounded up.
+ * NOTE: Only one of these can use timer 2 at a time (a timeout can't be running during TIMER_sleep).
+ * NOTE: TIMER_expired is set from the ISR, so interrupts must be enabled while waiting on it.
+*/
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+extern volatile bool TIMER_expired;//Set when a sleep chunk or timeout is over
+
+#define TIMER_sleep_us(us) do {TIMER_sleepTicks(TIMER_US_TO_TICKS(us));} while (0)
+#define TIMER_sleep_ms(ms) do {TIMER_sleepTicks(TIMER_US_TO_TICKS((ms) * 1000UL));} while (0)
+void TIMER_sleepTicks(uint16_t ticks);
+
+#define TIMER_MAX_TIMEOUT_TICKS 256
+void TIMER_startTimeout(uint16_t ticks);//1 to TIMER_MAX_TIMEOUT_TICKS; clears TIMER_expired
+void TIMER_stopTimeout();//Also turns off timer 2 (call even if it expired)
+
+/* Internal Functions/Macros */
+
+#define TIMER_PRESCALER 1024
+#define TIMER_US_TO_TICKS(us) \
+    ((uint16_t)((((us) * (F_CPU / 1000000UL)) + (TIMER_PRESCALER - 1)) / TIMER_PRESCALER))
+
+#endif//TIMER_H
@@ -4,21 +4,23 @@
 //Must be 16 characters
 #define ALARM_STRING "Wakey wakey, \x8\x1\x8"
 
-#include "eeprom.h"
+#include "settings.h"
 
 #include <stdbool.h>
 
 //For ui code
-void ALARM_setup();
-void ALARM_update();
+void ALARM_cacheAlarmTime();//Call after RTC_init and whenever alarm 2 is sent to the RTC
+void ALARM_setup();//Also starts the buzzer, which beeps until ALARM_stop
 bool ALARM_match();//Check if hours and minutes from RTC match alarm (even if ALARM_isEnabled == 0)
-#define ALARM_isEnabled() (EEPROM_read(0) != 0)
+bool ALARM_isDue();//True if RTC_now is at or one update before the cached alarm time (no I2C)
+#define ALARM_isEnabled() (SETTINGS_data.alarmEnabled)
 void ALARM_stop();
 
 //For menu code
 //Note: to configure the alarm itself, configure alarm2
-#define ALARM_enable() do {EEPROM_write(true, 0);} while (0)
-#define ALARM_disable() do {EEPROM_write(false, 0);} while (0)
+//NOTE: SETTINGS_save must be called afterwards to make the change persistent
+#define ALARM_enable() do {SETTINGS_data.alarmEnabled = true;} while (0)
+#define ALARM_disable() do {SETTINGS_data.alarmEnabled = false;} while (0)
 void ALARM_fillBufferWithAlarmTimeSnippet(char alarmSnippet[5]);
 
 #endif//ALARM_H
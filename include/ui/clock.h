@@ -1,6 +1,12 @@
 #ifndef CLOCK_H
 #define CLOCK_H
 
+/* Settings */
+
+//If 1, seconds are hidden and CLOCK mode wakes up once a minute (from RTC alarm 1) instead of
+//once a second (from the 1hz square wave). The timeout is then counted in minutes.
+#define CLOCK_MINUTE_RESOLUTION 0
+
 #include <avr/pgmspace.h>
 
 #include <stdint.h>
@@ -1,6 +1,6 @@
 #ifndef UI_H
 #define UI_H
 
-void UI_scheduler();//Takes over from main, never returns
+__attribute__((noreturn)) void UI_scheduler();//Takes over from main, never returns
 
 #endif//UI_H
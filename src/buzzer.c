@@ -5,6 +5,7 @@
 */
 
 #include "buzzer.h"
+#include "power.h"
 
 #include <avr/io.h>
 #include <stdint.h>
@@ -54,6 +55,7 @@ void buzzer_enable()
     PRR &= 0b11110111;//Enable timer 1
     SMCR = 0b00000001;//Change sleep mode to idle to allow timer 1 to run during sleep
     TCCR1A = TCCR1A_ENABLED;
+    POWER_accountOn(POWER_BUZZER);
 }
 
 void buzzer_disable()
@@ -61,4 +63,5 @@ void buzzer_disable()
     TCCR1A = TCCR1A_DISABLED;
     PRR |= 0b00001000;//Disable timer 1
     SMCR = 0b00000101;//Set sleep mode type back to power down (time 1 not needed)
+    POWER_accountOff(POWER_BUZZER);
 }
@@ -5,14 +5,56 @@
 */
 
 #include "eeprom.h" 
+#include "power.h"
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
+/* Typedefs and Constants */
+
+typedef struct
+{
+    uint16_t address;
+    uint8_t data;
+} pendingWrite_t;
+
+#define QUEUE_INDEX_MASK (EEPROM_QUEUE_LENGTH - 1)
+
+/* Static Variables */
+
+//Only modified with interrupts disabled (or by the ISR)
+static pendingWrite_t queue[EEPROM_QUEUE_LENGTH];
+static volatile uint8_t queueStart;//Oldest pending write
+static volatile uint8_t queueCount;
+
+static volatile bool idle = true;//Set by the ISR once the queue is empty and the last write is done
+
+/* Functions */
+
 uint8_t EEPROM_read(uint16_t address)
 {
-    while (EECR & (1 << 1));//Wait for a previous write to finish (EEPE to clear)
+    uint8_t oldSREG = SREG;
+    cli();//The ISR modifies the queue
+    
+    //If there are queued writes to this address, the newest one is what the EEPROM will contain
+    for (uint_fast8_t i = queueCount; i > 0; --i)
+    {
+        const pendingWrite_t* write = &queue[(queueStart + i - 1) & QUEUE_INDEX_MASK];
+        
+        if (write->address == address)
+        {
+            uint8_t data = write->data;
+            SREG = oldSREG;
+            return data;
+        }
+    }
+    
+    SREG = oldSREG;
+    
+    //Can't read while a write is in progress
+    EEPROM_waitUntilIdle();
     
     EEARH = (uint8_t)(address >> 8);//msbs of address
     EEARL = (uint8_t)(address & 0xFF);//lsbs of address
@@ -24,30 +66,87 @@ uint8_t EEPROM_read(uint16_t address)
 
 void EEPROM_write(uint8_t data, uint16_t address)
 {
-    EEPROM_swap(data, address);//Same as EEPROM_swap, but discards the old value
+    uint8_t oldSREG = SREG;
+    
+    while (true)
+    {
+        cli();//The ISR modifies the queue
+        
+        //Combine with a queued write to the same address if there is one
+        for (uint_fast8_t i = 0; i < queueCount; ++i)
+        {
+            pendingWrite_t* write = &queue[(queueStart + i) & QUEUE_INDEX_MASK];
+            
+            if (write->address == address)
+            {
+                write->data = data;
+                SREG = oldSREG;
+                return;
+            }
+        }
+        
+        if (queueCount < EEPROM_QUEUE_LENGTH)
+            break;
+        
+        //Queue is full, so wait for it to empty (this enables interrupts while sleeping)
+        SREG = oldSREG;
+        EEPROM_waitUntilIdle();
+    }
+    
+    pendingWrite_t* write = &queue[(queueStart + queueCount) & QUEUE_INDEX_MASK];
+    write->address = address;
+    write->data = data;
+    ++queueCount;
+    
+    idle = false;
+    EECR |= 1 << 3;//Set EERIE; the ISR fires as soon as the EEPROM is ready
+    SREG = oldSREG;
 }
 
 uint8_t EEPROM_swap(uint8_t data, uint16_t address)//Returns old data at address
+{
+    uint8_t oldData = EEPROM_read(address);//Includes queued writes
+    EEPROM_write(data, address);
+    return oldData;
+}
+
+bool EEPROM_isBusy()
+{
+    return !idle;
+}
+
+void EEPROM_waitUntilIdle()
+{
+    POWER_idleUntil(&idle);//EE_READY can't wake us from power down, so idle mode is used
+}
+
+/* ISRs */
+
+//Fires continuously while EERIE is set and no write is in progress
+ISR(EE_READY_vect)
 {
     //Assumes bits EEPM1 and EEPM0 within EECR are equal to zero
-    
-    cli();//Early to avoid any problems because of interrupts
-    
-    uint8_t oldData = EEPROM_read(address);//Will block while a previous write is in progress
     //NOTE: We don't have to worry about SELFPRGEN in SPMCSR because we never program flash
-    
-    if (data != oldData)//Save write wear
+    while (queueCount)
     {
-        //AVREEPROM_read already set the EEARH and EEARL registers, so we can skip that here
-        EEARH = (uint8_t)(address >> 8);//MSBs of address
-        EEARL = (uint8_t)(address & 0xFF);//LSBs of address
+        const pendingWrite_t* write = &queue[queueStart];
+        queueStart = (queueStart + 1) & QUEUE_INDEX_MASK;
+        --queueCount;
         
-        EEDR = data;
+        EEARH = (uint8_t)(write->address >> 8);//MSBs of address
+        EEARL = (uint8_t)(write->address & 0xFF);//LSBs of address
+        EECR |= 1;//Read the old data
         
-        EECR |= 1 << 2;//Set EEMPE (start of timed sequence)
-        EECR |= 1 << 1;//Set EEPE (end of timed sequence)
+        if (EEDR != write->data)//Save write wear
+        {
+            EEDR = write->data;
+            
+            EECR |= 1 << 2;//Set EEMPE (start of timed sequence)
+            EECR |= 1 << 1;//Set EEPE (end of timed sequence)
+            return;//Fires again once this write is finished
+        }
     }
     
-    sei();
-    return oldData;
+    EECR &= ~(1 << 3);//Nothing left to write, so clear EERIE
+    idle = true;
 }
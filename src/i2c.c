@@ -5,13 +5,94 @@
 */
 
 #include "i2c.h"
+#include "power.h"
+#include "timer.h"
+#include "lcd.h"
+#include "rtc.h"
 //Things that didn't make sense as macros :)
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include <avr/io.h>
-//TODO for interrupt-based IO in the future (can sleep while busywaiting)
-//#include <avr/interrupt.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/delay.h>
+
+#if defined(I2C_STATS) && (defined(PROFILE) || defined(POWER_ACCOUNTING))
+    #error "I2C_STATS can't be used with PROFILE or POWER_ACCOUNTING (they all need timer 0)."
+#endif
+
+/* Constants/Macros */
+
+#define TIMEOUT_TICKS TIMER_US_TO_TICKS(I2C_TIMEOUT_MS * 1000UL)
+
+//Bus recovery (bit-banged with the TWI off)
+#define SDA_PIN (1 << 4)
+#define SCL_PIN (1 << 5)
+#define RECOVERY_HALF_PERIOD_US 5//~100khz
+#define pullLow(pin) do {PORTC &= ~(pin); DDRC |= (pin);} while (0)
+#define release(pin) do {DDRC &= ~(pin); PORTC |= (pin);} while (0)//Back to the pullup
+
+#ifdef I2C_STATS
+    #define CYCLES_PER_COUNT 8//Timer 0 prescaler
+    #define DEVICE_PAGES 2//Pages for each device; after them, one page for each trace entry
+    
+    //Runs wait (a statement) and counts the time it took against address
+    #define WAIT_AND_COUNT(address, wait) do \
+    { \
+        uint32_t waitStart = now(); \
+        wait; \
+        stats[deviceIndex(address)].waitCycles += now() - waitStart; \
+    } while (0)
+    #define BEGIN_TRANSACTION() do {transactionStart = now(); transactionBytes = 0;} while (0)
+    #define COUNT_BYTE() do {++transactionBytes;} while (0)
+    #define END_TRANSACTION(address) do {recordTransaction(address, I2C_getStatus());} while (0)
+#else
+    #define WAIT_AND_COUNT(address, wait) do {wait;} while (0)
+    #define BEGIN_TRANSACTION() do {} while (0)
+    #define COUNT_BYTE() do {} while (0)
+    #define END_TRANSACTION(address) do {} while (0)
+#endif
+
+/* Static Variables */
+
+//Transactions waiting to run; the head is the one in progress (if any)
+static I2C_transaction_t* volatile queueHead = NULL;
+static I2C_transaction_t* queueTail = NULL;
+static uint8_t byteIndex;//Index into the write or read buffer of the transaction in progress
+
+#ifdef I2C_STATS
+static I2C_stats_t stats[I2C_STATS_DEVICES];
+static I2C_traceEntry_t trace[I2C_TRACE_LENGTH];
+static uint8_t traceNext;//Index the next transaction will be written to
+static uint8_t traceCount;//Entries filled so far (up to I2C_TRACE_LENGTH)
+
+static volatile uint32_t overflowCount;//Upper bits of the timestamp
+static uint32_t transactionStart;//Of the transaction in progress
+static uint8_t transactionBytes;
+static uint8_t syncAddress;//Of the transaction started by I2C_rawTransfer
+
+//Copies drawn by I2C_drawPage (the traffic from drawing the pages would change the originals)
+static I2C_stats_t shownStats[I2C_STATS_DEVICES];
+static I2C_traceEntry_t shownTrace[I2C_TRACE_LENGTH];
+static uint8_t shownTraceNext;
+static uint8_t shownTraceCount;
+#endif
+
+/* Static Function Declarations */
+
+static void setSpeedForAddress(uint8_t address);
+static void finishTransaction(uint8_t result);
+static bool waitForTWCR(uint8_t mask, uint8_t value);
+static uint8_t resultForStatus(uint8_t status);
+
+#ifdef I2C_STATS
+static uint32_t now();
+static uint8_t deviceIndex(uint8_t address);
+static void recordTransaction(uint8_t address, uint8_t status);
+static void printHex(uint8_t number);
+#endif
 
 /* Functions */
 
@@ -22,50 +103,548 @@ void I2C_init()
     //SCL (PC5) and SDA (PC4) start as inputs
     PORTC |= 0b00110000;//Set SCL and SDA high so that the internal pullups will be used
     
-    //Set master SCK frequency
-    //NOTE: No need to set TWBR to 0 because it is the default (Prescaler Value = 1)
+    //Set master SCK frequency (changed per device when each transfer begins)
     #if F_CPU < 2000000
         #error "Minimum supported frequency for I2C peripheral is 2MHz."
     #endif
-    TWBR = ((F_CPU / I2C_FREQ) - 16) / 2;//See datasheet page 221/222
+    #if ((F_CPU / I2C_FREQ_LCD) < 16) || ((F_CPU / I2C_FREQ_RTC) < 16) || \
+        ((F_CPU / I2C_FREQ_EEPROM) < 16) || ((F_CPU / I2C_FREQ_DEFAULT) < 16)
+        #error "An I2C device frequency is too high for F_CPU."
+    #endif
+    setSpeedForAddress(0);//Default speed
+}
+
+bool I2C_busyWait()
+{
+    return waitForTWCR(1 << 7, 1 << 7);//TWINT set
+}
+
+bool I2C_busyWaitStopBit()
+{
+    return waitForTWCR(1 << 4, 0);//TWSTO clear
+}
+
+void I2C_recoverBus()
+{
+    uint8_t oldSREG = SREG;
+    cli();//The ISR modifies the queue too
+    
+    TWCR = 0;//Turn off the TWI so SCL and SDA are ordinary pins (and it stops interrupting)
+    
+    //Give up on everything queued
+    I2C_transaction_t* transaction = queueHead;
+    queueHead = NULL;
+    while (transaction)
+    {
+        I2C_transaction_t* next = transaction->next;
+        transaction->result = I2C_TIMEOUT;
+        transaction->complete = true;
+        transaction = next;
+    }
+    
+    SREG = oldSREG;
+    
+    //A slave that was cut off in the middle of sending a byte holds SDA low until it gets the
+    //rest of its clocks (at most 8 bits and an ACK)
+    for (uint_fast8_t i = 0; (i < 9) && !(PINC & SDA_PIN); ++i)
+    {
+        pullLow(SCL_PIN);
+        _delay_us(RECOVERY_HALF_PERIOD_US);
+        release(SCL_PIN);
+        _delay_us(RECOVERY_HALF_PERIOD_US);
+    }
+    
+    //Start bit then stop bit, so every slave goes back to waiting for a start bit
+    pullLow(SDA_PIN);
+    _delay_us(RECOVERY_HALF_PERIOD_US);
+    release(SDA_PIN);
+    _delay_us(RECOVERY_HALF_PERIOD_US);
+    //The next command written to TWCR turns the TWI back on
 }
 
 //Convenience
 
 void I2C_endTransfer()
 {
+    END_TRANSACTION(syncAddress);
     I2C_sendStopBit();
     I2C_busyWaitStopBit();//Wait for stop bit to be sent
 }
 
-void I2C_sendByte(uint8_t byte)
+I2C_result_t I2C_sendByte(uint8_t byte)
 {
+    bool finished;
+    
     I2C_setByteToTransfer(byte);
     I2C_transferByteThenNACK();
-    I2C_busyWait();//Wait for byte to finish transfer
+    WAIT_AND_COUNT(syncAddress, finished = I2C_busyWait());//Wait for byte to finish transfer
+    COUNT_BYTE();
+    
+    return finished ? resultForStatus(I2C_getStatus()) : I2C_TIMEOUT;
 }
 
 uint8_t I2C_recieveByte()
 {
+    bool finished;
+    
     I2C_transferByteThenACK();
-    I2C_busyWait();//Wait for byte to be read into data register
-    return I2C_getByteRecieved();
+    //Wait for byte to be read into data register
+    WAIT_AND_COUNT(syncAddress, finished = I2C_busyWait());
+    COUNT_BYTE();
+    
+    return finished ? I2C_getByteRecieved() : 0xFF;//Like an empty bus
 }
 
 uint8_t I2C_recieveLastByte()
 {
+    bool finished;
+    
     I2C_transferByteThenNACK();//Send NACK instead of ACK for the last byte to receive
-    I2C_busyWait();//Wait for byte to be read into data register
-    return I2C_getByteRecieved();
+    //Wait for byte to be read into data register
+    WAIT_AND_COUNT(syncAddress, finished = I2C_busyWait());
+    COUNT_BYTE();
+    
+    return finished ? I2C_getByteRecieved() : 0xFF;//Like an empty bus
+}
+
+//Asynchronous Transactions
+
+void I2C_submit(I2C_transaction_t* transaction)
+{
+    transaction->next = NULL;
+    transaction->complete = false;
+    transaction->result = I2C_OK;
+    
+    uint8_t oldSREG = SREG;
+    cli();//The ISR modifies the queue too
+    
+    if (queueHead)//A transaction is in progress; the ISR will start this one after the others
+    {
+        queueTail->next = transaction;
+        queueTail = transaction;
+        SREG = oldSREG;
+        return;
+    }
+    
+    SREG = oldSREG;
+    
+    //The bus is free, so start right away. The ISR won't run again until we do, so interrupts
+    //can stay on while waiting for the previous stop bit to go out (the timeout needs them)
+    I2C_busyWaitStopBit();
+    queueHead = transaction;
+    queueTail = transaction;
+    setSpeedForAddress(transaction->address);
+    TWCR = I2C_ASYNC_START_BIT_COMMAND;//The ISR takes it from here
+}
+
+bool I2C_isIdle()
+{
+    return queueHead == NULL;
+}
+
+I2C_result_t I2C_waitForTransaction(const I2C_transaction_t* transaction)
+{
+    if (!transaction->complete)
+    {
+        //Idle mode keeps the TWI peripheral running
+        TIMER_startTimeout(TIMEOUT_TICKS);
+        WAIT_AND_COUNT(transaction->address,
+                       POWER_idleUntilEither(&transaction->complete, &TIMER_expired));
+        TIMER_stopTimeout();
+        
+        if (!transaction->complete)//The bus is stuck
+            I2C_recoverBus();//Completes every queued transaction with I2C_TIMEOUT
+    }
+    
+    return transaction->result;
+}
+
+void I2C_waitUntilIdle()
+{
+    while (!I2C_isIdle())
+        I2C_waitForTransaction(queueTail);//The last one queued is the last one to finish
+    
+    I2C_busyWaitStopBit();//Wait for the final stop bit to be sent (only a few microseconds)
 }
 
 //Internal Use Functions
 
-void I2C_rawTransfer(uint8_t addressAndRWBit)//Sends start bit, address and r/w bit
+I2C_result_t I2C_rawTransfer(uint8_t addressAndRWBit)//Sends start bit, address and r/w bit
 {
+    bool finished;
+    
+    I2C_waitUntilIdle();//Don't interfere with any asynchronous transactions
+    
+    #ifdef I2C_STATS
+        syncAddress = addressAndRWBit >> 1;
+    #endif
+    
+    setSpeedForAddress(addressAndRWBit >> 1);
+    BEGIN_TRANSACTION();
     I2C_sendStartBit();
-    I2C_busyWait();//Wait for start bit to be sent
+    WAIT_AND_COUNT(syncAddress, finished = I2C_busyWait());//Wait for start bit to be sent
+    if (!finished)
+        return I2C_TIMEOUT;
+    
     I2C_setByteToTransfer(addressAndRWBit);//Address and r/w bit combined
     I2C_transferAddress();
-    I2C_busyWait();//Wait for address to be transferred
+    WAIT_AND_COUNT(syncAddress, finished = I2C_busyWait());//Wait for address to be transferred
+    COUNT_BYTE();
+    
+    return finished ? resultForStatus(I2C_getStatus()) : I2C_TIMEOUT;
+}
+
+//Statistics
+
+#ifdef I2C_STATS
+void I2C_initStats()
+{
+    PRR &= ~(1 << 5);//Enable timer 0
+    TCCR0A = 0;//Normal mode
+    TCCR0B = 0b00000010;//Count at F_CPU/8 (it stops by itself in power down)
+    TIMSK0 = 1;//Enable the overflow interrupt
+    
+    uint8_t oldSREG = SREG;
+    cli();
+    
+    for (uint_fast8_t i = 0; i < I2C_STATS_DEVICES; ++i)
+        stats[i] = (I2C_stats_t){0};
+    traceNext = traceCount = 0;
+    TCNT0 = 0;
+    overflowCount = 0;
+    
+    SREG = oldSREG;
+}
+
+const I2C_stats_t* I2C_getStats(uint8_t device)
+{
+    return &stats[device];
+}
+
+const I2C_traceEntry_t* I2C_getTraceEntry(uint8_t age)
+{
+    if (age >= traceCount)
+        return NULL;
+    
+    return &trace[(traceNext + I2C_TRACE_LENGTH - 1 - age) % I2C_TRACE_LENGTH];
+}
+
+uint8_t I2C_getPageCount()
+{
+    return (I2C_STATS_DEVICES * DEVICE_PAGES) + I2C_TRACE_LENGTH;
+}
+
+void I2C_drawPage(uint8_t page)
+{
+    if (page == 0)//Take a new snapshot whenever the first page is shown
+    {
+        uint8_t oldSREG = SREG;
+        cli();
+        
+        for (uint_fast8_t i = 0; i < I2C_STATS_DEVICES; ++i)
+            shownStats[i] = stats[i];
+        for (uint_fast8_t i = 0; i < I2C_TRACE_LENGTH; ++i)
+            shownTrace[i] = trace[i];
+        shownTraceNext = traceNext;
+        shownTraceCount = traceCount;
+        
+        SREG = oldSREG;
+    }
+    
+    LCD_clear();
+    LCD_setDisplayAddress(0x00);
+    
+    if (page < (I2C_STATS_DEVICES * DEVICE_PAGES))
+    {
+        static const char PROGMEM names[I2C_STATS_DEVICES][4] = {"LCD", "RTC", "EEP", "Oth"};
+        const I2C_stats_t* device = &shownStats[page / DEVICE_PAGES];
+        LCD_print_P(names[page / DEVICE_PAGES]);
+        
+        if ((page % DEVICE_PAGES) == 0)//Transactions and bytes
+        {
+            LCD_print_P(PSTR(" txn"));
+            LCD_printNumber(device->transactions, 9);
+            LCD_setDisplayAddress(0x40);
+            LCD_print_P(PSTR("bytes"));
+            LCD_printNumber(device->bytes, 11);
+        }
+        else//NACKs and time waited
+        {
+            LCD_print_P(PSTR(" nack"));
+            LCD_printNumber(device->nacks, 8);
+            LCD_setDisplayAddress(0x40);
+            LCD_print_P(PSTR("wait"));
+            LCD_printNumber(device->waitCycles, 11);
+            LCD_writeCharacter('c');
+        }
+        
+        return;
+    }
+    
+    //One transaction, from the most recent: "#<age> A<address> L<length> S<status>" then the time
+    uint8_t age = page - (I2C_STATS_DEVICES * DEVICE_PAGES);
+    LCD_writeCharacter('#');
+    LCD_writeCharacter(age + '0');
+    
+    if (age >= shownTraceCount)
+    {
+        LCD_print_P(PSTR(" none"));
+        return;
+    }
+    
+    const I2C_traceEntry_t* entry =
+        &shownTrace[(shownTraceNext + I2C_TRACE_LENGTH - 1 - age) % I2C_TRACE_LENGTH];
+    LCD_print_P(PSTR(" A"));
+    printHex(entry->address);
+    LCD_print_P(PSTR(" L"));
+    LCD_printNumber(entry->length, 3);
+    LCD_print_P(PSTR(" S"));
+    printHex(entry->status);
+    LCD_setDisplayAddress(0x40);
+    LCD_writeCharacter('@');
+    LCD_printNumber(entry->timestamp, 14);
+    LCD_writeCharacter('c');
+}
+#endif
+
+
+/* Static Functions */
+
+static void setSpeedForAddress(uint8_t address)
+{
+    //NOTE: Only the prescaler bits of TWSR are writable
+    switch (address)
+    {
+        case LCD_ADDRESS:
+        {
+            TWBR = I2C_TWBR(I2C_FREQ_LCD);
+            TWSR = I2C_TWPS(I2C_FREQ_LCD);
+            break;
+        }
+        case RTC_ADDRESS:
+        {
+            TWBR = I2C_TWBR(I2C_FREQ_RTC);
+            TWSR = I2C_TWPS(I2C_FREQ_RTC);
+            break;
+        }
+        case I2C_EEPROM_ADDRESS:
+        {
+            TWBR = I2C_TWBR(I2C_FREQ_EEPROM);
+            TWSR = I2C_TWPS(I2C_FREQ_EEPROM);
+            break;
+        }
+        default:
+        {
+            TWBR = I2C_TWBR(I2C_FREQ_DEFAULT);
+            TWSR = I2C_TWPS(I2C_FREQ_DEFAULT);
+            break;
+        }
+    }
+}
+
+static void finishTransaction(uint8_t result)//Only call from the ISR
+{
+    I2C_transaction_t* finished = queueHead;
+    END_TRANSACTION(finished->address);
+    finished->result = result;
+    queueHead = finished->next;
+    finished->complete = true;
+    
+    if (queueHead)//Send a stop bit, then immediately start the next transaction
+    {
+        setSpeedForAddress(queueHead->address);
+        TWCR = I2C_ASYNC_STOP_START_COMMAND;
+    }
+    else//Release the bus; no more interrupts until the next I2C_submit
+        I2C_sendStopBit();
+}
+
+//Waits until (TWCR & mask) == value, recovering the bus if that takes over I2C_TIMEOUT_MS
+static bool waitForTWCR(uint8_t mask, uint8_t value)
+{
+    if ((TWCR & mask) == value)
+        return true;//Usually already done, so don't bother with the timer
+    
+    TIMER_startTimeout(TIMEOUT_TICKS);
+    while (((TWCR & mask) != value) && !TIMER_expired);
+    TIMER_stopTimeout();
+    
+    if ((TWCR & mask) == value)
+        return true;
+    
+    I2C_recoverBus();
+    return false;
+}
+
+static uint8_t resultForStatus(uint8_t status)
+{
+    switch (status)
+    {
+        case I2C_STATUS_ADDRESS_WRITE_NACK:
+        case I2C_STATUS_DATA_WRITE_NACK:
+        case I2C_STATUS_ADDRESS_READ_NACK:
+            return I2C_NACK;
+        case I2C_STATUS_ARBITRATION_LOST:
+            return I2C_ARBITRATION_LOST;
+        default:
+            return I2C_OK;
+    }
+}
+
+#ifdef I2C_STATS
+static uint32_t now()//In cycles (CYCLES_PER_COUNT at a time)
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    
+    uint8_t count = TCNT0;
+    uint32_t overflows = overflowCount;
+    if ((TIFR0 & 1) && (count != 0xFF))//Overflowed, but the ISR hasn't run yet
+        ++overflows;
+    
+    SREG = oldSREG;
+    return ((overflows << 8) | count) * CYCLES_PER_COUNT;
+}
+
+static uint8_t deviceIndex(uint8_t address)
+{
+    switch (address)
+    {
+        case LCD_ADDRESS:
+            return I2C_STATS_LCD;
+        case RTC_ADDRESS:
+            return I2C_STATS_RTC;
+        case I2C_EEPROM_ADDRESS:
+            return I2C_STATS_EEPROM;
+        default:
+            return I2C_STATS_OTHER;
+    }
+}
+
+static void recordTransaction(uint8_t address, uint8_t status)//Call before the stop bit
+{
+    I2C_stats_t* device = &stats[deviceIndex(address)];
+    ++device->transactions;
+    device->bytes += transactionBytes;
+    
+    if ((status == I2C_STATUS_ADDRESS_WRITE_NACK) || (status == I2C_STATUS_DATA_WRITE_NACK) ||
+        (status == I2C_STATUS_ADDRESS_READ_NACK))
+        ++device->nacks;
+    
+    I2C_traceEntry_t* entry = &trace[traceNext];
+    entry->timestamp = transactionStart;
+    entry->address = address;
+    entry->length = transactionBytes;
+    entry->status = status;
+    
+    traceNext = (traceNext + 1) % I2C_TRACE_LENGTH;
+    if (traceCount < I2C_TRACE_LENGTH)
+        ++traceCount;
+}
+
+static void printHex(uint8_t number)//Always 2 digits
+{
+    static const char PROGMEM digits[] = "0123456789ABCDEF";
+    LCD_writeCharacter(pgm_read_byte(&digits[number >> 4]));
+    LCD_writeCharacter(pgm_read_byte(&digits[number & 0xF]));
+}
+#endif
+
+/* ISRs */
+
+//State machine for asynchronous transactions; fires whenever TWINT is set
+ISR(TWI_vect)
+{
+    I2C_transaction_t* transaction = queueHead;
+    uint8_t status = I2C_getStatus();
+    
+    //Every status other than these means a byte (address or data) was just transferred
+    if ((status != I2C_STATUS_START) && (status != I2C_STATUS_REPEATED_START) &&
+        (status != I2C_STATUS_ARBITRATION_LOST))
+        COUNT_BYTE();
+    
+    switch (status)
+    {
+        case I2C_STATUS_START:
+        {
+            byteIndex = 0;
+            BEGIN_TRANSACTION();
+            
+            //Only begin by reading if there is nothing to write
+            I2C_setAddressToTransfer(transaction->address, transaction->writeCount == 0);
+            TWCR = I2C_ASYNC_TRANSFER_NACK_COMMAND;//Allow slave to ACK
+            break;
+        }
+        case I2C_STATUS_REPEATED_START://Done writing, so switch to reading
+        {
+            byteIndex = 0;
+            
+            I2C_setAddressToTransfer(transaction->address, 1);
+            TWCR = I2C_ASYNC_TRANSFER_NACK_COMMAND;//Allow slave to ACK
+            break;
+        }
+        case I2C_STATUS_ADDRESS_WRITE_ACK:
+        case I2C_STATUS_DATA_WRITE_ACK:
+        {
+            if (byteIndex < transaction->writeCount)//Send the next byte
+            {
+                const uint8_t* byte = transaction->writeBuffer + byteIndex;
+                
+                if (transaction->flags & I2C_WRITE_FROM_PROGMEM)
+                    I2C_setByteToTransfer(pgm_read_byte(byte));
+                else
+                    I2C_setByteToTransfer(*byte);
+                
+                ++byteIndex;
+                TWCR = I2C_ASYNC_TRANSFER_NACK_COMMAND;
+            }
+            else if (transaction->readCount)
+                TWCR = I2C_ASYNC_START_BIT_COMMAND;//Repeated start to begin reading
+            else
+                finishTransaction(I2C_OK);
+            
+            break;
+        }
+        case I2C_STATUS_ADDRESS_READ_ACK:
+        {
+            //NACK must be used for the last byte received
+            if (transaction->readCount > 1)
+                TWCR = I2C_ASYNC_TRANSFER_ACK_COMMAND;
+            else
+                TWCR = I2C_ASYNC_TRANSFER_NACK_COMMAND;
+            
+            break;
+        }
+        case I2C_STATUS_DATA_READ_ACK:
+        {
+            transaction->readBuffer[byteIndex] = I2C_getByteRecieved();
+            ++byteIndex;
+            
+            //NACK must be used for the last byte received
+            if (byteIndex < (transaction->readCount - 1))
+                TWCR = I2C_ASYNC_TRANSFER_ACK_COMMAND;
+            else
+                TWCR = I2C_ASYNC_TRANSFER_NACK_COMMAND;
+            
+            break;
+        }
+        case I2C_STATUS_DATA_READ_NACK://Last byte
+        {
+            transaction->readBuffer[byteIndex] = I2C_getByteRecieved();
+            finishTransaction(I2C_OK);
+            break;
+        }
+        default://Slave NACKed or arbitration was lost; give up on this transaction
+        {
+            finishTransaction(resultForStatus(status));
+            break;
+        }
+    }
+}
+
+#ifdef I2C_STATS
+ISR(TIMER0_OVF_vect)
+{
+    ++overflowCount;
 }
+#endif
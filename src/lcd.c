@@ -11,11 +11,13 @@
 
 #include "lcd.h"
 #include "i2c.h"
+#include "timer.h"
+#include "power.h"
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
-#include <util/delay.h>
 #include <avr/io.h>
 #include <avr/pgmspace.h>
 
@@ -24,196 +26,365 @@
 typedef enum {COMMAND = 0b0, DATA = 0b1} lcdByteType_t;
 typedef const LCD_bitmap_t (*LCD_cgramPointer_t);
 
+//34 LCD bytes (4 I2C bytes each); enough for the worst case redraw in LCD_flush (32 characters
+//and an address command for each line) to fit in a single transaction. Glyph uploads (up to 68
+//more LCD bytes, only after LCD_setCGRAM_P or a power loss) share the buffer, so a flush with them
+//is split into more transactions when it fills up.
+#define TRANSFER_BUFFER_SIZE 136
+
+#define toShadowIndex(address) ((((address) & 0x40) >> 2) | ((address) & 0x0F))
+#define toDisplayAddress(index) ((((index) & 0x10) << 2) | ((index) & 0x0F))
+
 /* Static Variables */
 
 static LCD_cgramPointer_t cgramPointer;
+static uint8_t cgramDirty = 0xFF;//Bit n is set if glyph n must be uploaded to the display
+
+static bool panelInitialized;//False if the module lost power since it was last initialized
+static uint8_t backLightBit = 0b00001000;//Cleared in standby
+
+//What the UI wants on the display (written freely) and what the display actually holds
+static char shadow[32] = "                                ";
+static char displayed[32];
+static uint8_t cursorAddress;//Display address for the next write to the shadow buffer
+static bool displayOn;//If false, LCD_flush does nothing (the display is off or has no power)
+
+//I2C bytes are queued here, then sent by the I2C ISR while we do other things (or sleep)
+static uint8_t transferBuffer[TRANSFER_BUFFER_SIZE];
+static I2C_transaction_t transaction =
+{
+    .address = LCD_ADDRESS,
+    .writeBuffer = transferBuffer,
+    .complete = true//Nothing has been sent yet
+};
 
 /* Private Functions/Macros */
 
-static void latchInLCDByte(uint8_t byte, lcdByteType_t byteType)
+static void beginTransfer()
+{
+    I2C_waitForTransaction(&transaction);//Can't touch the buffer until the last transfer is done
+    transaction.writeCount = 0;
+}
+
+static void endTransfer()
 {
-    uint8_t backLightBit = 0b00001000;//Force backlight on
+    I2C_submit(&transaction);//Does not wait for the transfer to finish
+}
+
+static void disconnect()//Stop using the module until LCD_on or LCD_init finds it again
+{
+    PORTB |= 1 << 2;//Set PB2 high to turn off PNP transistor (it isn't answering anyway)
+    panelInitialized = false;
     
+    if (displayOn)
+    {
+        displayOn = false;
+        POWER_accountOff(POWER_LCD);
+    }
+}
+
+static void queueRawByte(uint8_t byte)
+{
+    if (transaction.writeCount == TRANSFER_BUFFER_SIZE)//Buffer full, so send what we have so far
+    {
+        endTransfer();
+        beginTransfer();
+    }
+    
+    transferBuffer[transaction.writeCount] = byte;
+    ++transaction.writeCount;
+}
+
+static void latchInLCDByte(uint8_t byte, lcdByteType_t byteType)
+{
     //For commands, the RS and R/W lines stay low (byteType will be 0b0)
     //For data, RS goes high and the R/W lines stay low (byteType will be 0b1)
     uint8_t highNibble = (byte & 0xF0) | backLightBit | byteType;
     uint8_t lowNibble = (byte << 4) | backLightBit | byteType;
     
     //Write and latch each nibble of the byte (LCDs latch on the negative edge)
-    I2C_busyWait();//Wait for previous transfer to complete if any
-    
-    I2C_sendByte(highNibble | 0b00000100);
-    I2C_sendByte(highNibble);//Bring enable line low to create a negedge
-    I2C_sendByte(lowNibble | 0b00000100);
-    
-    //For the last transfer (latching the low nibble), we don't busy wait right away in order to 
-    //allow productive code to take up some of the busywaiting time
-    I2C_setByteToTransfer(lowNibble);//Bring enable line low to create a negedge
-    I2C_transferByteThenNACK();
-}
-
-static void beginTransferNoEndBusyWait()
-{
-    I2C_sendStartBit();
-    I2C_busyWait();//Wait for start bit to be sent
-    I2C_setByteToTransfer(LCD_ADDRESS << 1);//Address and write bit (0) combined
-    I2C_transferAddress();
+    queueRawByte(highNibble | 0b00000100);
+    queueRawByte(highNibble);//Bring enable line low to create a negedge
+    queueRawByte(lowNibble | 0b00000100);
+    queueRawByte(lowNibble);//Bring enable line low to create a negedge
 }
 
-static void initCGRAM_P()
+static void uploadDirtyGlyphs()//Only call between beginTransfer and endTransfer
 {
-    beginTransferNoEndBusyWait();//Writing
-    
-    //Start by setting CGRAM address to 0
-    latchInLCDByte(0b01000000, COMMAND);
+    bool addressCounterValid = false;//The address counter auto-increments between glyphs
     
-    //Copy CGRAM contents
     for (uint_fast8_t i = 0; i < 8; ++i)
     {
-        for (uint_fast8_t j = 0; j < 8; ++j)
-            latchInLCDByte(pgm_read_byte(&cgramPointer[i][j]), DATA);
+        if (cgramDirty & (1 << i))
+        {
+            if (!addressCounterValid)
+            {
+                latchInLCDByte(0b01000000 | (i << 3), COMMAND);//Set CGRAM address
+                addressCounterValid = true;
+            }
+            
+            for (uint_fast8_t j = 0; j < 8; ++j)
+                latchInLCDByte(pgm_read_byte(&cgramPointer[i][j]), DATA);
+        }
+        else
+            addressCounterValid = false;
     }
-
-    I2C_busyWait();
-    I2C_endTransfer();//Done copying CGRAM contents
+    
+    cgramDirty = 0;
 }
 
 /* Public Functions */
 
 void LCD_setCGRAM_P(const LCD_cgram_t cgram)
 {
-    cgramPointer = cgram;
+    //Only glyphs that differ from the current ones need to be uploaded again
+    if (cgramPointer)
+    {
+        for (uint_fast8_t i = 0; i < 8; ++i)
+        {
+            for (uint_fast8_t j = 0; j < 8; ++j)
+            {
+                if (pgm_read_byte(&cgram[i][j]) != pgm_read_byte(&cgramPointer[i][j]))
+                {
+                    cgramDirty |= 1 << i;
+                    break;
+                }
+            }
+        }
+    }
+    
+    cgramPointer = cgram;//Glyphs are uploaded by the next LCD_flush
 }
 
-void LCD_init()
+I2C_result_t LCD_init()
 {
     DDRB |= 1 << 2;//Set PB2 as output
     PORTB &= ~(1 << 2);//Set PB2 low to turn on PNP transistor
     
-    _delay_ms(15);
+    TIMER_sleep_ms(15);//Power up time
     //Set LCD to 4 bit access mode and enable backlight
     //Note that I2C backback makes 4 LSBS 1 so the display is set to 2 line and 5x11 characters
-    I2C_beginTransfer(LCD_ADDRESS, 0);//Writing
+    beginTransfer();
     //First, ensure we start in 8 bit mode
     for (uint_fast8_t i = 0; i < 3; ++i)//Useful: https://www.microchip.com/forums/m734545.aspx
     {
         //0b0011XXXX with enable line high, RS and R/W low, backlight on
-        I2C_sendByte(0b00111100);
-        I2C_sendByte(0b00111000);//Same, but with enable line brought low
+        queueRawByte(0b00111100);
+        queueRawByte(0b00111000);//Same, but with enable line brought low
     }
     //Now that we know we're in 8 bit mode, set to 4 bit mode
-    I2C_sendByte(0b00101100);//0b001011XX with enable line high, RS and R/W low, backlight on
-    I2C_sendByte(0b00101000);//Same, but with enable line brought low
+    queueRawByte(0b00101100);//0b001011XX with enable line high, RS and R/W low, backlight on
+    queueRawByte(0b00101000);//Same, but with enable line brought low
     
     //Now that we're in 4 bit mode, init display w/ no cursor; also clear display
     latchInLCDByte(0b00001100, COMMAND);//Init display
     latchInLCDByte(0b00000001, COMMAND);//Clear display
-    I2C_busyWait();
-    I2C_endTransfer();
-    _delay_us(1520);//Wait after clearing display
+    endTransfer();
+    
+    //The delay must start after the clear is latched in
+    I2C_result_t result = I2C_waitForTransaction(&transaction);
+    if (result != I2C_OK)
+    {
+        disconnect();
+        return result;
+    }
+    
+    TIMER_sleep_us(1520);//Wait after clearing display
+    
+    //The display was just cleared and its CGRAM contents are garbage; the next LCD_flush will
+    //upload every glyph and draw whatever is in the shadow buffer
+    memset(displayed, ' ', 32);
+    cgramDirty = 0xFF;
+    backLightBit = 0b00001000;
+    panelInitialized = true;
+    displayOn = true;
+    POWER_accountOn(POWER_LCD);
+    return I2C_OK;
+}
+
+I2C_result_t LCD_on()
+{
+    if (!panelInitialized)//The module lost power, so it must be initialized from scratch
+        return LCD_init();
+    else if (!displayOn)//Resume from standby (DDRAM and CGRAM contents were kept)
+    {
+        backLightBit = 0b00001000;
+        beginTransfer();
+        latchInLCDByte(0b00001100, COMMAND);//Display on w/ no cursor
+        endTransfer();
+        displayOn = true;
+        POWER_accountOn(POWER_LCD);
+    }
+    //Else the display is already on, so there's nothing to do
     
-    initCGRAM_P();//Initialize the LCD's CGRAM now that it is on
+    return I2C_OK;
 }
 
 void LCD_off()
 {
-    PORTB |= 1 << 2;//Set PB2 high to turn off PNP transistor
+    #if LCD_CUT_POWER_WHEN_OFF
+        I2C_waitForTransaction(&transaction);//Let the last transfer finish before cutting power
+        PORTB |= 1 << 2;//Set PB2 high to turn off PNP transistor
+        panelInitialized = false;
+    #else
+        backLightBit = 0;
+        beginTransfer();
+        latchInLCDByte(0b00001000, COMMAND);//Display off (also turns off the backlight)
+        endTransfer();
+    #endif
+    
+    displayOn = false;
+    POWER_accountOff(POWER_LCD);//Standby draws very little without the backlight
 }
 
 void LCD_clear()
 {
-    LCD_sendCommand(0b00000001);
-    _delay_us(1520);
+    memset(shadow, ' ', 32);
+}
+
+void LCD_setDisplayAddress(uint8_t address)
+{
+    cursorAddress = address;
 }
 
 void LCD_writeCharacter(char character)
 {
-    beginTransferNoEndBusyWait();//Writing
-    latchInLCDByte(character, DATA);
-    I2C_busyWait();
-    I2C_endTransfer();
+    if ((cursorAddress & 0x3F) < 16)//Like the display, writes past the 16th column are not visible
+        shadow[toShadowIndex(cursorAddress)] = character;
+    
+    ++cursorAddress;//Auto-increment like the display does
 }
 
-void LCD_print(const char* string)
+void LCD_flush()
 {
-    beginTransferNoEndBusyWait();//Writing
+    if (!displayOn)
+        return;
+    
+    //The last transfer has almost always finished by now; if it failed, the module is gone
+    if (I2C_waitForTransaction(&transaction) != I2C_OK)
+    {
+        disconnect();
+        return;
+    }
+    
+    bool transferStarted = false;
     
+    if (cgramDirty)//Glyphs go first so they're correct by the time the characters are drawn
+    {
+        beginTransfer();
+        transferStarted = true;
+        uploadDirtyGlyphs();
+    }
+    
+    uint8_t lastIndexWritten = 0xFF;//None yet, so the display's address counter is unknown
+    
+    for (uint_fast8_t i = 0; i < 32; ++i)
+    {
+        if (shadow[i] == displayed[i])
+            continue;//Nothing to do for this character
+        
+        if (!transferStarted)
+        {
+            beginTransfer();
+            transferStarted = true;
+        }
+        
+        //The address counter auto-increments, so an address command is only needed for gaps
+        //(and when moving to the second line)
+        bool sameLine = (lastIndexWritten != 0xFF) && (((i ^ lastIndexWritten) & 0x10) == 0);
+        if (sameLine && (lastIndexWritten == (i - 2)))
+        {
+            //Rewriting a single unchanged character costs the same as an address command
+            latchInLCDByte(shadow[i - 1], DATA);
+        }
+        else if (!sameLine || (lastIndexWritten != (i - 1)))
+            latchInLCDByte(0b10000000 | toDisplayAddress(i), COMMAND);//Set display address
+        
+        latchInLCDByte(shadow[i], DATA);
+        displayed[i] = shadow[i];
+        lastIndexWritten = i;
+    }
+    
+    if (transferStarted)
+        endTransfer();//All changed characters are sent in a single transaction
+}
+
+void LCD_print(const char* string)
+{
     while (true)
     {
         char character = *string;
         
         if (character)//Not null byte, so write character
-            latchInLCDByte(character, DATA);
+            LCD_writeCharacter(character);
         else
             break;//End printing loop
         
         ++string;
     }
-    
-    I2C_busyWait();
-    I2C_endTransfer();//Done printing string
 }
 
 void LCD_print_P(PGM_P string)
 {
-    beginTransferNoEndBusyWait();//Writing
-    
     while (true)
     {
         char character = pgm_read_byte(string);
         
         if (character)//Not null byte, so write character
-            latchInLCDByte(character, DATA);
+            LCD_writeCharacter(character);
         else
             break;//End printing loop
         
         ++string;
     }
-    
-    I2C_busyWait();
-    I2C_endTransfer();//Done printing string
 }
 
 void LCD_printAmount(const char* string, uint8_t n)
 {
-    beginTransferNoEndBusyWait();//Writing
-    
     for (uint8_t i = 0; i < n; ++i)
     {
-        char character = *string;
-        
-        latchInLCDByte(character, DATA);
-        
+        LCD_writeCharacter(*string);
         ++string;
     }
-    
-    I2C_busyWait();
-    I2C_endTransfer();//Done printing string
 }
 
 void LCD_printAmount_P(PGM_P string, uint8_t n)//String in program space (eg. PSTR("Hello World!"))
 {
-    beginTransferNoEndBusyWait();//Writing
-    
     for (uint8_t i = 0; i < n; ++i)
     {
-        char character = pgm_read_byte(string);
-        
-        latchInLCDByte(character, DATA);
-        
+        LCD_writeCharacter(pgm_read_byte(string));
         ++string;
     }
+}
+
+void LCD_printNumber(uint32_t number, uint8_t width)
+{
+    char digits[10];//Least significant first
+    uint8_t digitCount = 0;
     
-    I2C_busyWait();
-    I2C_endTransfer();//Done printing string
+    do
+    {
+        digits[digitCount] = (number % 10) + '0';
+        number /= 10;
+        ++digitCount;
+    }
+    while (number);
+    
+    for (uint8_t i = digitCount; i < width; ++i)
+        LCD_writeCharacter(' ');
+    
+    while (digitCount)
+    {
+        --digitCount;
+        LCD_writeCharacter(digits[digitCount]);
+    }
 }
 
 /* Internal Functions/Macros */
 
 void LCD_sendCommand(uint8_t command)
 {
-    beginTransferNoEndBusyWait();//Writing
+    beginTransfer();
     latchInLCDByte(command, COMMAND);
-    I2C_busyWait();
-    I2C_endTransfer();
+    endTransfer();
 }
@@ -27,11 +27,10 @@
  * RTClk: 0x68
  * 
  * EEPROM map
- * 0x00: Alarm enabled
- * 0x01: Timeout value
+ * See settings.h
 */
 
-#ifndef __AVR_ARCH__
+#if !defined(__AVR_ARCH__) && !defined(HOST_BUILD)
     #error "Unsupported platform."
 #endif
 
@@ -43,7 +42,12 @@
 #include "buzzer.h"
 #include "i2c.h"
 #include "lcd.h"
+#include "power.h"
+#include "profile.h"
 #include "rtc.h"
+#include "scheduler.h"
+#include "settings.h"
+#include "ui/alarm.h"
 #include "ui/ui.h"
 
 #include <avr/io.h>
@@ -59,9 +63,18 @@ int main()
 {
     //Initialize power-saving settings
     lowPowerConfig();
+    PROFILE_init();//Does nothing unless PROFILE is defined
+    
+    //Load the settings from the EEPROM into RAM
+    SETTINGS_load();
+    
+    //Initialize the software timers (before anything that might start one)
+    SCHEDULER_init();
+    POWER_initAccounting();//Does nothing unless POWER_ACCOUNTING is defined
     
     //Initialize the I2C interface
     I2C_init();
+    I2C_initStats();//Does nothing unless I2C_STATS is defined
     
     //Initialize the LCD and display the splash screen
     LCD_setCGRAM_P(bitmaps);
@@ -73,6 +86,7 @@ int main()
     
     //Initialize the RTC
     RTC_init();
+    ALARM_cacheAlarmTime();//RTC_init read alarm 2
     
     //Setup interrupts (must be done after all other initialization)
     initInterrupts();
@@ -87,6 +101,7 @@ static void splash()
     LCD_print_P(PSTR("atmegaclock2 " CMAKE_VERSION_MAJOR_STR "." CMAKE_VERSION_MINOR_STR));
     LCD_setDisplayAddress(0x40);//Second line
     LCD_print_P(PSTR("\x2\x4\x5\x6\x7    By: \x8\x1\x8"));
+    LCD_flush();
 }
 
 static void lowPowerConfig()
@@ -0,0 +1,262 @@
+/* Power management code
+ * By: John Jekel
+ *
+ * Sleep helpers shared by the drivers, and optional power accounting (see power.h).
+*/
+
+#include "power.h"
+
+#include <stdbool.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+void POWER_idleUntilEither(const volatile bool* flag, const volatile bool* otherFlag)
+{
+    uint8_t oldSMCR = SMCR;
+    SMCR = 0b00000001;//Idle mode keeps the peripheral clocks running while we sleep
+    
+    while (true)
+    {
+        cli();//Avoid the ISR setting the flag between checking it and sleeping
+        
+        if (*flag || *otherFlag)
+            break;
+        
+        //The instruction after sei is always executed before any interrupts, so we can't miss one
+        POWER_accountSleep();
+        sei();
+        sleep_cpu();
+        POWER_accountWake();
+    }
+    
+    sei();
+    SMCR = oldSMCR;
+}
+
+#ifdef POWER_ACCOUNTING
+
+#ifdef PROFILE
+    #error "PROFILE and POWER_ACCOUNTING both need timer 0"
+#endif
+
+#include "scheduler.h"
+#include "lcd.h"
+
+#include <avr/pgmspace.h>
+
+/* Constants/Macros */
+
+#define ACTIVE 0
+#define IDLE 1
+#define POWER_DOWN 2
+#define toStateIndex(cpuState, parts) (((cpuState) << 3) | (parts))
+#define STATE_COUNT toStateIndex(POWER_DOWN + 1, 0)
+
+#define COUNT_US 64//Timer 0 at F_CPU/1024
+#define COUNTS_PER_TICK (SCHEDULER_TICK_MS * 1000 / COUNT_US)//Nominal watchdog tick
+
+/* Static Variables */
+
+static uint64_t stateTime[STATE_COUNT];//In timer 0 counts
+
+static uint8_t cpuState = ACTIVE;
+static uint8_t parts = POWER_I2C;//lowPowerConfig leaves only the TWI peripheral powered
+static uint8_t powerDownParts = POWER_I2C;//Parts powered during the last power down sleep
+
+static volatile uint32_t overflowCount;//Upper bits of the timestamp
+static uint32_t lastChange;//When the current state began
+static uint32_t lastUpdate;//When updatePowerDown last ran
+static uint16_t lastUpdateTick;//The scheduler's tick then
+
+static SCHEDULER_timer_t updateTimer;
+
+/* Static Function Declarations */
+
+static uint32_t now();
+static void changeState(uint8_t newCPUState, uint8_t newParts);
+static void updatePowerDown();
+static uint32_t getCurrent(uint8_t state);
+
+/* Functions */
+
+void POWER_initAccounting()
+{
+    PRR &= ~(1 << 5);//Enable timer 0
+    TCCR0A = 0;//Normal mode
+    TCCR0B = 0b00000101;//Count at F_CPU/1024
+    TIMSK0 = 1;//Enable the overflow interrupt
+    
+    lastChange = lastUpdate = now();
+    lastUpdateTick = SCHEDULER_getTick();
+    
+    updateTimer.callback = updatePowerDown;
+    SCHEDULER_start(&updateTimer, POWER_ACCOUNTING_PERIOD, POWER_ACCOUNTING_PERIOD);
+}
+
+void POWER_accountOn(uint8_t newParts)
+{
+    changeState(cpuState, parts | newParts);
+}
+
+void POWER_accountOff(uint8_t oldParts)
+{
+    changeState(cpuState, parts & ~oldParts);
+}
+
+void POWER_accountSleep()
+{
+    uint8_t mode = SMCR & 0b00001110;
+    if (mode == 0)//Idle
+        changeState(IDLE, parts);
+    else//Power down (the only other mode used)
+    {
+        changeState(POWER_DOWN, parts);//Timer 0 stops, so no time is counted here by changeState
+        powerDownParts = parts;
+    }
+}
+
+void POWER_accountWake()
+{
+    changeState(ACTIVE, parts);
+}
+
+uint32_t POWER_getAverageCurrent()
+{
+    uint64_t total = 0;
+    uint64_t weighted = 0;//Counts * uA
+    
+    for (uint_fast8_t i = 0; i < STATE_COUNT; ++i)
+    {
+        total += stateTime[i];
+        weighted += stateTime[i] * getCurrent(i);
+    }
+    
+    return total ? (weighted / total) : 0;
+}
+
+uint8_t POWER_getPageCount()
+{
+    return 1 + STATE_COUNT;
+}
+
+void POWER_drawPage(uint8_t page)
+{
+    LCD_clear();
+    LCD_setDisplayAddress(0x00);
+    
+    if (!page)//Summary
+    {
+        uint32_t average = POWER_getAverageCurrent();
+        LCD_print_P(PSTR("avg"));
+        LCD_printNumber(average, 11);
+        LCD_print_P(PSTR("uA"));
+        
+        LCD_setDisplayAddress(0x40);
+        uint32_t mAhPerDayTimes10 = (average * 24) / 100;
+        LCD_printNumber(mAhPerDayTimes10 / 10, 8);
+        LCD_writeCharacter('.');
+        LCD_writeCharacter((mAhPerDayTimes10 % 10) + '0');
+        LCD_print_P(PSTR("mAh/d"));
+        return;
+    }
+    
+    uint8_t state = page - 1;
+    
+    //Eg. "Idle LCD BZ I2C"
+    switch (state >> 3)
+    {
+        case ACTIVE:
+        {
+            LCD_print_P(PSTR("Act "));
+            break;
+        }
+        case IDLE:
+        {
+            LCD_print_P(PSTR("Idle"));
+            break;
+        }
+        default:
+        {
+            LCD_print_P(PSTR("PD  "));
+            break;
+        }
+    }
+    LCD_print_P((state & POWER_LCD) ? PSTR(" LCD") : PSTR("    "));
+    LCD_print_P((state & POWER_BUZZER) ? PSTR(" BZ") : PSTR("   "));
+    LCD_print_P((state & POWER_I2C) ? PSTR(" I2C") : PSTR("    "));
+    
+    //Time in seconds and current draw
+    LCD_setDisplayAddress(0x40);
+    LCD_printNumber((stateTime[state] * COUNT_US) / 1000000, 7);
+    LCD_writeCharacter('s');
+    LCD_printNumber(getCurrent(state), 6);
+    LCD_print_P(PSTR("uA"));
+}
+
+/* Static Functions */
+
+static uint32_t now()//In timer 0 counts (COUNT_US each)
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    
+    uint8_t count = TCNT0;
+    uint32_t overflows = overflowCount;
+    if ((TIFR0 & 1) && (count != 0xFF))//Overflowed, but the ISR hasn't run yet
+        ++overflows;
+    
+    SREG = oldSREG;
+    return (overflows << 8) | count;
+}
+
+static void changeState(uint8_t newCPUState, uint8_t newParts)
+{
+    uint32_t time = now();
+    stateTime[toStateIndex(cpuState, parts)] += time - lastChange;
+    lastChange = time;
+    
+    cpuState = newCPUState;
+    parts = newParts;
+}
+
+static void updatePowerDown()//Scheduler callback; runs about every POWER_ACCOUNTING_PERIOD ticks
+{
+    uint32_t time = now();
+    uint32_t counted = time - lastUpdate;//Active and idle time seen by timer 0
+    lastUpdate = time;
+    
+    //The ticks the watchdog actually counted, in case this runs late or other timers moved them
+    uint16_t tick = SCHEDULER_getTick();
+    uint32_t elapsed = (uint32_t)(uint16_t)(tick - lastUpdateTick) * COUNTS_PER_TICK;
+    lastUpdateTick = tick;
+    
+    if (elapsed > counted)
+        stateTime[toStateIndex(POWER_DOWN, powerDownParts)] += elapsed - counted;
+}
+
+static uint32_t getCurrent(uint8_t state)//In uA
+{
+    static const uint16_t cpuCurrent[3] PROGMEM =
+        {POWER_CURRENT_ACTIVE, POWER_CURRENT_IDLE, POWER_CURRENT_POWER_DOWN};
+    
+    uint32_t current = POWER_CURRENT_ALWAYS + pgm_read_word(&cpuCurrent[state >> 3]);
+    if (state & POWER_LCD)
+        current += POWER_CURRENT_LCD;
+    if (state & POWER_BUZZER)
+        current += POWER_CURRENT_BUZZER;
+    if (state & POWER_I2C)
+        current += POWER_CURRENT_I2C;
+    
+    return current;
+}
+
+/* ISRs */
+
+ISR(TIMER0_OVF_vect)
+{
+    ++overflowCount;
+}
+
+#endif//POWER_ACCOUNTING
@@ -0,0 +1,240 @@
+/* Profiling code
+ * By: John Jekel
+ *
+ * Timestamps wakes with timer 0 and keeps min/max/mean/histogram statistics for them.
+ * See profile.h for what is measured.
+*/
+
+#ifdef PROFILE
+
+#include "profile.h"
+#include "lcd.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+/* Constants/Macros and Typedefs */
+
+#define CYCLES_PER_COUNT 8//Timer 0 prescaler
+#define PAGES_PER_STAT 3
+
+//Order of the stats array
+#define DECIDE_STAT 0
+#define FIRST_SETUP_STAT 1
+#define FIRST_UPDATE_STAT (FIRST_SETUP_STAT + PROFILE_MODE_SLOTS)
+#define FIRST_AWAKE_STAT (FIRST_UPDATE_STAT + PROFILE_MODE_SLOTS)
+#define FIRST_EVENT_STAT (FIRST_AWAKE_STAT + PROFILE_MODE_SLOTS)
+#define STAT_COUNT (FIRST_EVENT_STAT + PROFILE_EVENT_SLOTS)
+
+typedef struct
+{
+    uint32_t min;//In timer counts, like the rest
+    uint32_t max;
+    uint32_t sum;
+    uint16_t count;
+    uint16_t histogram[PROFILE_HISTOGRAM_BUCKETS];
+} stat_t;
+
+/* Static Variables */
+
+static stat_t stats[STAT_COUNT];
+
+static volatile uint32_t overflowCount;//Upper bits of the timestamp
+static bool asleep;//Timer 0 is stopped; the next wake starts it again
+static uint32_t wakeTime;
+static uint32_t eventStartTime;
+static uint32_t handlerStartTime;
+
+/* Static Function Declarations */
+
+static uint32_t now();
+static void record(uint8_t stat, uint32_t duration);
+
+/* Functions */
+
+void PROFILE_init()
+{
+    PRR &= ~(1 << 5);//Enable timer 0
+    TCCR0A = 0;//Normal mode
+    TCCR0B = 0b00000010;//Start counting at F_CPU/8
+    TIMSK0 = 1;//Enable the overflow interrupt
+    
+    for (uint_fast8_t i = 0; i < STAT_COUNT; ++i)
+        stats[i].min = 0xFFFFFFFF;
+    
+    wakeTime = eventStartTime = now();//Treat boot as a wake
+}
+
+void PROFILE_markWake()
+{
+    if (!asleep)
+        return;//Not the first interrupt since waking up (or we never slept)
+    
+    TCCR0B = 0b00000010;//Start counting again
+    wakeTime = eventStartTime = now();
+    asleep = false;
+}
+
+void PROFILE_markDecided()
+{
+    record(DECIDE_STAT, now() - eventStartTime);
+}
+
+void PROFILE_markHandlerStart()
+{
+    handlerStartTime = now();
+}
+
+void PROFILE_markSetupDone(uint8_t mode)
+{
+    record(FIRST_SETUP_STAT + mode, now() - handlerStartTime);
+}
+
+void PROFILE_markUpdateDone(uint8_t mode)
+{
+    record(FIRST_UPDATE_STAT + mode, now() - handlerStartTime);
+}
+
+void PROFILE_markHandled(uint8_t eventType)
+{
+    uint32_t handledTime = now();
+    record(FIRST_EVENT_STAT + eventType, handledTime - eventStartTime);
+    eventStartTime = handledTime;//If there's no sleep, the next event starts now
+}
+
+void PROFILE_markSleep(uint8_t mode)
+{
+    if (asleep)
+        return;//Went back to sleep after an interrupt that didn't wake the UI
+    
+    record(FIRST_AWAKE_STAT + mode, now() - wakeTime);
+    TCCR0B = 0;//Stop counting so only awake time is measured
+    asleep = true;
+}
+
+uint8_t PROFILE_getPageCount()
+{
+    return STAT_COUNT * PAGES_PER_STAT;
+}
+
+void PROFILE_drawPage(uint8_t page)
+{
+    uint8_t index = page / PAGES_PER_STAT;
+    const stat_t* stat = &stats[index];
+    
+    LCD_clear();
+    LCD_setDisplayAddress(0x00);
+    
+    if ((page % PAGES_PER_STAT) == 1)//Min and max (no room for the name)
+    {
+        LCD_print_P(PSTR("min"));
+        LCD_printNumber(stat->count ? (stat->min * CYCLES_PER_COUNT) : 0, 12);
+        LCD_writeCharacter('c');
+        LCD_setDisplayAddress(0x40);
+        LCD_print_P(PSTR("max"));
+        LCD_printNumber(stat->max * CYCLES_PER_COUNT, 12);
+        LCD_writeCharacter('c');
+        return;
+    }
+    
+    if (index == DECIDE_STAT)
+        LCD_print_P(PSTR("Decide"));
+    else if (index < FIRST_UPDATE_STAT)
+    {
+        LCD_print_P(PSTR("Setup M"));
+        LCD_writeCharacter((index - FIRST_SETUP_STAT) + '0');
+    }
+    else if (index < FIRST_AWAKE_STAT)
+    {
+        LCD_print_P(PSTR("Update M"));
+        LCD_writeCharacter((index - FIRST_UPDATE_STAT) + '0');
+    }
+    else if (index < FIRST_EVENT_STAT)
+    {
+        LCD_print_P(PSTR("Awake M"));
+        LCD_writeCharacter((index - FIRST_AWAKE_STAT) + '0');
+    }
+    else
+    {
+        LCD_print_P(PSTR("Event E"));
+        LCD_writeCharacter((index - FIRST_EVENT_STAT) + '0');
+    }
+    
+    if ((page % PAGES_PER_STAT) == 0)//Sample count and mean
+    {
+        LCD_setDisplayAddress(0x0A);
+        LCD_printNumber(stat->count, 6);
+        LCD_setDisplayAddress(0x40);
+        LCD_print_P(PSTR("avg"));
+        LCD_printNumber(stat->count ? ((stat->sum / stat->count) * CYCLES_PER_COUNT) : 0, 12);
+        LCD_writeCharacter('c');
+    }
+    else//Histogram, scaled so the biggest bucket is 9
+    {
+        uint16_t biggest = 1;
+        for (uint_fast8_t i = 0; i < PROFILE_HISTOGRAM_BUCKETS; ++i)
+        {
+            if (stat->histogram[i] > biggest)
+                biggest = stat->histogram[i];
+        }
+        
+        LCD_setDisplayAddress(0x40);
+        LCD_print_P(PSTR("hist "));
+        for (uint_fast8_t i = 0; i < PROFILE_HISTOGRAM_BUCKETS; ++i)
+            LCD_writeCharacter((((uint32_t)stat->histogram[i] * 9) / biggest) + '0');
+    }
+}
+
+/* Static Functions */
+
+static uint32_t now()//In timer counts (CYCLES_PER_COUNT cycles each)
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    
+    uint8_t count = TCNT0;
+    uint32_t overflows = overflowCount;
+    if ((TIFR0 & 1) && (count != 0xFF))//Overflowed, but the ISR hasn't run yet
+        ++overflows;
+    
+    SREG = oldSREG;
+    return (overflows << 8) | count;
+}
+
+static void record(uint8_t stat, uint32_t duration)
+{
+    stat_t* s = &stats[stat];
+    
+    if (duration < s->min)
+        s->min = duration;
+    if (duration > s->max)
+        s->max = duration;
+    
+    if (s->count != 0xFFFF)//Stop once the count would overflow so the mean stays correct
+    {
+        s->sum += duration;
+        ++s->count;
+    }
+    
+    //Bucket n holds durations under 1024 * 4^n cycles (128 * 4^n counts)
+    uint8_t bucket = 0;
+    for (uint32_t limit = 1024 / CYCLES_PER_COUNT; (duration >= limit) &&
+         (bucket < (PROFILE_HISTOGRAM_BUCKETS - 1)); limit *= 4)
+        ++bucket;
+    
+    if (s->histogram[bucket] != 0xFFFF)
+        ++s->histogram[bucket];
+}
+
+/* ISRs */
+
+ISR(TIMER0_OVF_vect)
+{
+    ++overflowCount;
+}
+
+#endif//PROFILE
@@ -2,52 +2,388 @@
 #include "i2c.h"
 
 #include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+
+/* Constants/Macros */
+
+#define REGISTER_COUNT 19
+
+#define registerBit(index) ((uint32_t)1 << (index))
+#define rangeMask(startIndex, count) ((registerBit(count) - 1) << (startIndex))
+
+#define MAX_GAP 2//Most unchanged registers RTC_commit writes to join two runs into one transfer
+
+//Registers the RTC changes by itself: time and date, status (0xF, its flags) and temperature
+#define VOLATILE_REGISTERS (rangeMask(0x0, 7) | rangeMask(0xF, 1) | rangeMask(0x11, 2))
+
+#define TIME_AND_DATE_REGISTERS 7
+
+//The BCD encodings of (tens * 10) to (tens * 10) + 9
+#define BCD_ROW(tens) ((tens) << 4) | 0, ((tens) << 4) | 1, ((tens) << 4) | 2, ((tens) << 4) | 3, \
+                      ((tens) << 4) | 4, ((tens) << 4) | 5, ((tens) << 4) | 6, ((tens) << 4) | 7, \
+                      ((tens) << 4) | 8, ((tens) << 4) | 9
 
 /* Variables */
 
-uint8_t RTC_data[19];
+RTC_registers_t RTC_registers;
+RTC_datetime_t RTC_now;
+
+const uint8_t PROGMEM RTC_bcdTable[100] =
+{
+    BCD_ROW(0), BCD_ROW(1), BCD_ROW(2), BCD_ROW(3), BCD_ROW(4),
+    BCD_ROW(5), BCD_ROW(6), BCD_ROW(7), BCD_ROW(8), BCD_ROW(9)
+};
+
+_Static_assert(sizeof(RTC_registers_t) == REGISTER_COUNT, "RTC_registers_t isn't the DS3231's");
+
+/* Static Variables */
+
+//Days in each month, and before each month (in a year that isn't a leap year)
+static const uint8_t PROGMEM daysInMonthTable[12] =
+    {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+static const uint16_t PROGMEM daysBeforeMonthTable[12] =
+    {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+
+static uint8_t minutesUntilSync;
+
+//What the RTC holds as far as we know (only for registers with their bit in validRegisters)
+static uint8_t rtcCopy[REGISTER_COUNT];
+static uint32_t validRegisters;//Bit n is set if rtcCopy[n] is known to match the RTC
+static uint32_t dirtyRegisters;//Bit n is set if RTC_data[n] is to be written by RTC_commit
+
+static uint8_t transferBuffer[20];//Register address followed by up to 19 registers
+static I2C_transaction_t transaction =
+{
+    .address = RTC_ADDRESS,
+    .writeBuffer = transferBuffer,
+    .complete = true//Nothing has been sent yet
+};
+
+/* Static Function Declarations */
+
+static void waitForLastTransfer();
+static void sendDataRange(uint8_t startIndex, uint8_t count);
+static void decodeTimeAndDate(uint8_t startIndex, uint8_t count);
+static void encodeTimeAndDate();
+static uint8_t getDaysInMonth();
 
 /* Functions */
 
-void RTC_init()
+I2C_result_t RTC_init()
 {
+    RTC_invalidateAll();
+    
     //Perform the initial read of data from the RTC to the RTC_data[] buffer
-    RTC_refreshA2();
+    //If the RTC didn't answer, don't overwrite its alarm settings with the defaults in RTC_data
+    I2C_result_t result = RTC_refreshAlarms();
+    if (result != I2C_OK)
+        return result;
+    
+    //Configure alarm 1 to fire once per minute (when the seconds are 00) for when CLOCK mode
+    //wakes up once a minute instead of once a second
+    RTC_registers.alarm1.seconds.units = 0;
+    RTC_registers.alarm1.seconds.tens = 0;
+    RTC_registers.alarm1.seconds.mask = 0;
+    RTC_registers.alarm1.minutes.mask = 1;
+    RTC_registers.alarm1.hours.mask = 1;
+    RTC_registers.alarm1.date.mask = 1;
     
     //Ensure only minutes and hours are used for the alarm comparison by configuring mask values
-    RTC_setMaskA2(2, 0);
-    RTC_setMaskA2(3, 0);
-    RTC_setMaskA2(4, 1);
+    RTC_registers.alarm2.minutes.mask = 0;
+    RTC_registers.alarm2.hours.mask = 0;
+    RTC_registers.alarm2.date.mask = 1;
+    
+    //Update the RTC with those new values in the buffer (only what isn't already set)
+    RTC_sendAlarms();
+    RTC_commit();
+    return I2C_OK;
+}
+
+I2C_result_t RTC_sync()
+{
+    I2C_result_t result = RTC_refreshTimeAndDate();
+    minutesUntilSync = (result == I2C_OK) ? RTC_SYNC_INTERVAL : 1;
+    return result;
+}
+
+void RTC_tick()
+{
+    if (RTC_now.seconds < 59)
+    {
+        ++RTC_now.seconds;
+        RTC_data[0x0] = RTC_toBCD(RTC_now.seconds);
+    }
+    else
+        RTC_tickMinute();
+}
+
+void RTC_tickMinute()
+{
+    RTC_now.seconds = 0;
+    RTC_data[0x0] = 0x00;
+    
+    //Once a minute, check if it's time to correct any drift by reading from the RTC again
+    --minutesUntilSync;
+    if (!minutesUntilSync && (RTC_sync() == I2C_OK))
+        return;//Else keep counting in software until the RTC answers again
+    
+    if (RTC_now.minutes < 59)
+    {
+        ++RTC_now.minutes;
+        RTC_data[0x1] = RTC_toBCD(RTC_now.minutes);
+        return;//The usual case
+    }
+    
+    RTC_now.minutes = 0;
+    
+    if (RTC_now.hours < 23)
+        ++RTC_now.hours;
+    else
+    {
+        RTC_now.hours = 0;
+        RTC_now.day = (RTC_now.day < 7) ? (RTC_now.day + 1) : 1;
+        
+        if (RTC_now.date < getDaysInMonth())
+            ++RTC_now.date;
+        else
+        {
+            RTC_now.date = 1;
+            
+            if (RTC_now.month < 12)
+                ++RTC_now.month;
+            else
+            {
+                RTC_now.month = 1;
+                
+                if (RTC_now.year < 99)
+                    ++RTC_now.year;
+                else
+                {
+                    RTC_now.year = 0;
+                    RTC_now.century = !RTC_now.century;
+                }
+            }
+        }
+    }
+    
+    encodeTimeAndDate();
+}
+
+uint16_t RTC_dayOfCentury(const RTC_datetime_t* datetime)
+{
+    //Like the DS3231, every year divisible by 4 is a leap year (year 00 included)
+    uint16_t days = ((uint16_t)datetime->year * 365) + ((datetime->year + 3) / 4);
+    days += pgm_read_word(&daysBeforeMonthTable[datetime->month - 1]);
+    
+    if ((datetime->month > 2) && !(datetime->year % 4))
+        ++days;//This year's February 29th
     
-    //Update the RTC with those new values in the buffer
-    RTC_sendA2();
+    return days + datetime->date - 1;
 }
 
-void RTC_refreshDataRange(uint8_t startIndex, uint8_t count)
+void RTC_commit()
 {
-    I2C_beginTransfer(RTC_ADDRESS, 0);//Write address to start reading from
-    I2C_sendByte(startIndex);//Set address pointer to startIndex
-    I2C_beginTransfer(RTC_ADDRESS, 1);//Now we start reading from address 0 (repeated start)
+    waitForLastTransfer();//If the last send failed, none of its registers can be left out
+    
+    //Find the registers that are dirty and not already the same in the RTC, and those that can
+    //be written again harmlessly (known, unchanged and not changed by the RTC itself)
+    uint32_t write = 0;
+    uint32_t harmless = 0;
     
-    //Read registers from RTC
-    for (uint_fast8_t i = 0; i < (count - 1); ++i)//All registers except last
-        RTC_data[startIndex + i] = I2C_recieveByte();
+    for (uint_fast8_t i = 0; i < REGISTER_COUNT; ++i)
+    {
+        uint32_t bit = registerBit(i);
+        bool same = (validRegisters & bit) && (RTC_data[i] == rtcCopy[i]);
+        
+        if (!same)
+            write |= dirtyRegisters & bit;
+        else if (!(VOLATILE_REGISTERS & bit))
+            harmless |= bit;
+    }
     
-    //The last register is the last byte read, so we use I2C_recieveLastByte instead
-    RTC_data[startIndex + count - 1] = I2C_recieveLastByte();
+    dirtyRegisters = 0;
     
-    I2C_endTransfer();//Done receiving data
+    //Each run of registers to write is sent in one transfer. A short gap between two runs is sent
+    //too if it's harmless, since that's fewer bytes than the address and register pointer of
+    //another transfer.
+    uint_fast8_t runStart = 0;
+    while (write)
+    {
+        while (!(write & registerBit(runStart)))
+            ++runStart;
+        
+        uint_fast8_t runEnd = runStart;
+        while (true)
+        {
+            while ((runEnd < REGISTER_COUNT) && (write & registerBit(runEnd)))
+                ++runEnd;
+            
+            uint_fast8_t gapEnd = runEnd;
+            while ((gapEnd < REGISTER_COUNT) && ((gapEnd - runEnd) < MAX_GAP) &&
+                   (harmless & registerBit(gapEnd)))
+                ++gapEnd;
+            
+            if ((gapEnd == runEnd) || (gapEnd == REGISTER_COUNT) || !(write & registerBit(gapEnd)))
+                break;
+            
+            runEnd = gapEnd;//Bridge the gap and continue with the next run
+        }
+        
+        sendDataRange(runStart, runEnd - runStart);
+        write &= ~rangeMask(runStart, runEnd - runStart);
+        runStart = runEnd;
+    }
+}
+
+void RTC_invalidateVolatile()
+{
+    validRegisters &= ~VOLATILE_REGISTERS;
 }
 
-void RTC_sendDataRange(uint8_t startIndex, uint8_t count)
+void RTC_invalidateAll()
 {
-    I2C_beginTransfer(RTC_ADDRESS, 0);//Writing
-    I2C_sendByte(startIndex);//Set address pointer to startIndex
+    validRegisters = 0;
+    dirtyRegisters = 0;
+}
+
+I2C_result_t RTC_refreshDataRange(uint8_t startIndex, uint8_t count)
+{
+    uint32_t mask = rangeMask(startIndex, count);
+    
+    if (dirtyRegisters & mask)
+        RTC_commit();//So what we read back includes them
     
-    //Write to all I2C registers
-    for (uint_fast8_t i = 0; i < count; ++i)
-        I2C_sendByte(RTC_data[startIndex + i]);
+    //A previous send may still be using the buffer, and if it failed, we don't know what the RTC
+    //holds anymore (so this must come before deciding to skip the read)
+    waitForLastTransfer();
     
-    I2C_endTransfer();//Done sending data
+    //Skip the read if we know what the RTC has and RTC_data wasn't changed since
+    bool known = (validRegisters & mask) == mask;
+    if (known && !memcmp(RTC_data + startIndex, rtcCopy + startIndex, count))
+        return I2C_OK;
+    
+    transferBuffer[0] = startIndex;//Set address pointer to startIndex
+    transaction.writeCount = 1;
+    transaction.readBuffer = transferBuffer + 1;//Not RTC_data, in case only some bytes arrive
+    transaction.readCount = count;
+    
+    I2C_submit(&transaction);
+    
+    //Sleep until the registers have been read
+    I2C_result_t result = I2C_waitForTransaction(&transaction);
+    if (result == I2C_OK)
+    {
+        memcpy(RTC_data + startIndex, transferBuffer + 1, count);
+        memcpy(rtcCopy + startIndex, transferBuffer + 1, count);
+        validRegisters |= mask;
+        decodeTimeAndDate(startIndex, count);
+    }
+    
+    return result;
+}
+
+void RTC_markDirty(uint8_t startIndex, uint8_t count)
+{
+    dirtyRegisters |= rangeMask(startIndex, count);
+    decodeTimeAndDate(startIndex, count);//They may have been set digit by digit
+}
+
+/* Static Functions */
+
+static void waitForLastTransfer()
+{
+    //If the last send failed, we don't know which of its registers the RTC got
+    if (I2C_waitForTransaction(&transaction) != I2C_OK)
+        validRegisters = 0;
+}
+
+static void sendDataRange(uint8_t startIndex, uint8_t count)
+{
+    waitForLastTransfer();//A previous send may still be using the buffer
+    
+    transferBuffer[0] = startIndex;//Set address pointer to startIndex
+    memcpy(transferBuffer + 1, RTC_data + startIndex, count);
+    memcpy(rtcCopy + startIndex, RTC_data + startIndex, count);
+    validRegisters |= rangeMask(startIndex, count);
+    
+    transaction.writeCount = count + 1;
+    transaction.readCount = 0;
+    
+    I2C_submit(&transaction);//No need to wait; RTC_data can be modified while this is sent
+}
+
+static void decodeTimeAndDate(uint8_t startIndex, uint8_t count)//Only the registers given
+{
+    uint_fast8_t end = startIndex + count;
+    if (end > TIME_AND_DATE_REGISTERS)
+        end = TIME_AND_DATE_REGISTERS;
+    
+    for (uint_fast8_t i = startIndex; i < end; ++i)
+    {
+        switch (i)
+        {
+            case 0x0:
+            {
+                RTC_now.seconds = RTC_fromBCD(RTC_registers.seconds);
+                break;
+            }
+            case 0x1:
+            {
+                RTC_now.minutes = RTC_fromBCD(RTC_registers.minutes);
+                break;
+            }
+            case 0x2:
+            {
+                RTC_now.hours = RTC_fromBCD(RTC_registers.hours);//Assumes 24 hour time
+                break;
+            }
+            case 0x3:
+            {
+                RTC_now.day = RTC_registers.day.day;
+                break;
+            }
+            case 0x4:
+            {
+                RTC_now.date = RTC_fromBCD(RTC_registers.date);
+                break;
+            }
+            case 0x5:
+            {
+                RTC_now.month = RTC_fromBCD(RTC_registers.month);
+                RTC_now.century = RTC_registers.month.century;
+                break;
+            }
+            case 0x6:
+            {
+                RTC_now.year = RTC_fromBCD(RTC_registers.year);
+                break;
+            }
+        }
+    }
+}
+
+static void encodeTimeAndDate()//From RTC_now (in 24 hour time)
+{
+    RTC_data[0x0] = RTC_toBCD(RTC_now.seconds);
+    RTC_data[0x1] = RTC_toBCD(RTC_now.minutes);
+    RTC_data[0x2] = RTC_toBCD(RTC_now.hours);
+    RTC_data[0x3] = RTC_now.day;
+    RTC_data[0x4] = RTC_toBCD(RTC_now.date);
+    RTC_data[0x5] = RTC_toBCD(RTC_now.month) | (RTC_now.century ? 0x80 : 0x00);
+    RTC_data[0x6] = RTC_toBCD(RTC_now.year);
+}
+
+static uint8_t getDaysInMonth()
+{
+    if (RTC_now.month == 2)
+    {
+        //Like the DS3231 itself, treat every year divisible by 4 as a leap year (including 2100)
+        //so we don't disagree with it between syncs
+        return (RTC_now.year % 4) ? 28 : 29;
+    }
+    else
+        return pgm_read_byte(&daysInMonthTable[RTC_now.month - 1]);
 }
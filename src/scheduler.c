@@ -0,0 +1,261 @@
+/* Scheduler code
+ * By: John Jekel
+ *
+ * Software timers kept in a hierarchical timer wheel, driven by the watchdog timer interrupt.
+ *
+ * Level 0 has a slot for each of the next 16 ticks, level 1 has a slot for each of the next 16
+ * groups of 16 ticks, and anything further away waits in an overflow list. When level 0 wraps
+ * around, the timers in the next level 1 slot are moved down; when level 1 wraps around, the
+ * overflow list is redistributed.
+*/
+
+#include "scheduler.h"
+#include "profile.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/wdt.h>
+
+/* Constants/Macros */
+
+#define SLOTS_PER_LEVEL 16
+#define SLOT_MASK (SLOTS_PER_LEVEL - 1)
+#define MAX_WATCHDOG_PRESCALER 9//8 seconds (512 ticks)
+
+/* Static Variables */
+
+static SCHEDULER_timer_t* level0[SLOTS_PER_LEVEL];//1 tick per slot
+static SCHEDULER_timer_t* level1[SLOTS_PER_LEVEL];//16 ticks per slot
+static SCHEDULER_timer_t* overflow;//256 or more ticks away
+
+static uint16_t currentTick;//The last tick processed by SCHEDULER_run
+static uint8_t activeTimers;
+
+static volatile uint16_t pendingTicks;//Added to by the ISR, taken by SCHEDULER_run
+static uint16_t watchdogPeriod;//In ticks; 0 if the watchdog is stopped
+static uint16_t watchdogExpiry;//currentTick once the watchdog's current period has been run
+
+/* Static Function Declarations */
+
+static void insertTimer(SCHEDULER_timer_t* timer);
+static bool removeFromList(SCHEDULER_timer_t** list, SCHEDULER_timer_t* timer);
+static void cascade(SCHEDULER_timer_t** list);
+static uint16_t ticksUntilNextDeadline();
+static void setWatchdogPeriod(uint16_t maxTicks);
+
+/* Functions */
+
+void SCHEDULER_init()
+{
+    MCUSR &= ~(1 << 3);//Clear WDRF; it would otherwise force the watchdog into reset mode
+    setWatchdogPeriod(0);//Stopped until a timer is started
+}
+
+void SCHEDULER_start(SCHEDULER_timer_t* timer, uint16_t delay, uint16_t period)
+{
+    if (timer->active)
+        SCHEDULER_stop(timer);
+    
+    //Ticks that elapsed but weren't processed yet count towards the delay too
+    timer->expiry = currentTick + delay;
+    timer->period = period;
+    timer->active = true;
+    ++activeTimers;
+    insertTimer(timer);
+    
+    //Restarting the watchdog drops the part of its period that already elapsed, so only do it if
+    //the new timer is due before the watchdog would fire
+    if (!watchdogPeriod || (delay < (uint16_t)(watchdogExpiry - currentTick)))
+        setWatchdogPeriod(delay);
+}
+
+void SCHEDULER_stop(SCHEDULER_timer_t* timer)
+{
+    if (!timer->active)
+        return;
+    
+    //We don't know which list it's in, so try them all (there are very few timers)
+    bool removed = removeFromList(&overflow, timer);
+    for (uint_fast8_t i = 0; !removed && (i < SLOTS_PER_LEVEL); ++i)
+        removed = removeFromList(&level0[i], timer) || removeFromList(&level1[i], timer);
+    
+    timer->active = false;
+    --activeTimers;
+    //NOTE: The watchdog is stopped the next time SCHEDULER_run finds there are no active timers
+}
+
+void SCHEDULER_run()
+{
+    cli();
+    uint16_t ticks = pendingTicks;
+    pendingTicks = 0;
+    sei();
+    
+    bool watchdogFired = ticks != 0;
+    
+    while (ticks)
+    {
+        --ticks;
+        ++currentTick;
+        
+        if (!(currentTick & SLOT_MASK))//Level 0 wrapped around
+        {
+            if (!((currentTick >> 4) & SLOT_MASK))//Level 1 wrapped around too
+                cascade(&overflow);
+            
+            cascade(&level1[(currentTick >> 4) & SLOT_MASK]);
+        }
+        
+        //Every timer in this slot is due now
+        SCHEDULER_timer_t** slot = &level0[currentTick & SLOT_MASK];
+        while (*slot)
+        {
+            SCHEDULER_timer_t* timer = *slot;
+            *slot = timer->next;
+            
+            if (timer->period)//Periodic, so schedule the next one before the callback runs
+            {
+                timer->expiry += timer->period;
+                insertTimer(timer);
+            }
+            else
+            {
+                timer->active = false;
+                --activeTimers;
+            }
+            
+            timer->callback();//May start or stop timers
+        }
+    }
+    
+    if (!activeTimers)
+    {
+        if (watchdogPeriod)
+            setWatchdogPeriod(0);
+        return;
+    }
+    
+    //Most wakes are for something else (eg. the 1hz interrupt), and restarting the watchdog then
+    //would throw away the time already counted towards its period
+    uint16_t untilDeadline = ticksUntilNextDeadline();
+    bool dueSooner = untilDeadline < (uint16_t)(watchdogExpiry - currentTick);
+    if (watchdogFired || !watchdogPeriod || dueSooner)
+        setWatchdogPeriod(untilDeadline);
+}
+
+bool SCHEDULER_isPending()
+{
+    return pendingTicks != 0;
+}
+
+uint16_t SCHEDULER_getTick()
+{
+    return currentTick;
+}
+
+/* Static Functions */
+
+static void insertTimer(SCHEDULER_timer_t* timer)
+{
+    uint16_t ticksAway = timer->expiry - currentTick;
+    SCHEDULER_timer_t** list;
+    
+    if (ticksAway < SLOTS_PER_LEVEL)
+        list = &level0[timer->expiry & SLOT_MASK];
+    else if (ticksAway < (SLOTS_PER_LEVEL * SLOTS_PER_LEVEL))
+        list = &level1[(timer->expiry >> 4) & SLOT_MASK];
+    else
+        list = &overflow;
+    
+    timer->next = *list;
+    *list = timer;
+}
+
+static bool removeFromList(SCHEDULER_timer_t** list, SCHEDULER_timer_t* timer)
+{
+    while (*list)
+    {
+        if (*list == timer)
+        {
+            *list = timer->next;
+            return true;
+        }
+        
+        list = &(*list)->next;
+    }
+    
+    return false;
+}
+
+static void cascade(SCHEDULER_timer_t** list)//Reinserts each timer in the list (moving them down)
+{
+    SCHEDULER_timer_t* timer = *list;
+    *list = NULL;
+    
+    while (timer)
+    {
+        SCHEDULER_timer_t* next = timer->next;
+        insertTimer(timer);
+        timer = next;
+    }
+}
+
+static uint16_t ticksUntilNextDeadline()
+{
+    uint16_t soonest = 0xFFFF;
+    
+    //Level 0 slots are in order, so the first non-empty one is the soonest
+    for (uint_fast8_t i = 1; i <= SLOTS_PER_LEVEL; ++i)
+    {
+        if (level0[(currentTick + i) & SLOT_MASK])
+            return i;
+    }
+    
+    //Otherwise check everything else (there are very few timers)
+    for (uint_fast8_t i = 0; i < SLOTS_PER_LEVEL; ++i)
+    {
+        for (SCHEDULER_timer_t* timer = level1[i]; timer; timer = timer->next)
+        {
+            if ((uint16_t)(timer->expiry - currentTick) < soonest)
+                soonest = timer->expiry - currentTick;
+        }
+    }
+    for (SCHEDULER_timer_t* timer = overflow; timer; timer = timer->next)
+    {
+        if ((uint16_t)(timer->expiry - currentTick) < soonest)
+            soonest = timer->expiry - currentTick;
+    }
+    
+    return soonest;
+}
+
+static void setWatchdogPeriod(uint16_t maxTicks)//0 stops the watchdog
+{
+    uint8_t prescaler = 0;//Period is 2^prescaler ticks
+    while ((prescaler < MAX_WATCHDOG_PRESCALER) && ((2u << prescaler) <= maxTicks))
+        ++prescaler;
+    
+    //WDIE to use interrupt mode (not reset mode); WDP3 is separate from WDP[2:0]
+    uint8_t settings = 0b01000000 | ((prescaler & 0b1000) << 2) | (prescaler & 0b0111);
+    
+    cli();
+    wdt_reset();//Restart the period from now
+    WDTCSR |= 0b00011000;//Set WDCE and WDE (start of timed sequence)
+    WDTCSR = maxTicks ? settings : 0;//End of timed sequence
+    watchdogPeriod = maxTicks ? (1 << prescaler) : 0;
+    watchdogExpiry = currentTick + watchdogPeriod;
+    sei();
+}
+
+/* ISRs */
+
+ISR(WDT_vect)
+{
+    PROFILE_markWake();
+    pendingTicks += watchdogPeriod;
+    return;//Exit sleep so SCHEDULER_run can handle the timers
+}
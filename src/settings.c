@@ -0,0 +1,138 @@
+/* Settings code
+ * By: John Jekel
+ *
+ * Keeps the persistent settings in RAM, loading/saving them from/to a journal in the internal
+ * EEPROM.
+*/
+
+#include "settings.h"
+#include "eeprom.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include <util/crc16.h>
+
+/* Typedefs and Constants */
+
+typedef struct
+{
+    uint16_t sequence;//Incremented for each record written; 0xFFFF means the slot is empty
+    uint8_t version;//SETTINGS_VERSION
+    SETTINGS_t data;
+    uint8_t reserved[SETTINGS_RECORD_SIZE - 4 - sizeof(SETTINGS_t)];//Always 0xFF
+    uint8_t crc;//CRC8 of all of the above
+} record_t;
+
+_Static_assert(sizeof(record_t) == SETTINGS_RECORD_SIZE, "SETTINGS_t is too big for a record");
+
+#define RECORD_COUNT ((E2END + 1) / SETTINGS_RECORD_SIZE)
+#define EMPTY_SEQUENCE 0xFFFF
+
+//True if sequence number a was written after b (handles wraparound)
+#define isNewer(a, b) ((int16_t)((uint16_t)(a) - (uint16_t)(b)) > 0)
+
+/* Variables */
+
+SETTINGS_t SETTINGS_data;
+
+/* Static Variables */
+
+static SETTINGS_t storedData;//What the newest record contains, so unchanged settings aren't saved
+static uint8_t newestSlot = RECORD_COUNT - 1;//So that the first record goes in slot 0
+static uint16_t newestSequence = EMPTY_SEQUENCE;//So that the first record is sequence 0
+
+/* Static Function Declarations */
+
+static void readRecord(uint8_t slot, record_t* record);
+static uint8_t calculateCRC(const record_t* record);
+
+/* Functions */
+
+void SETTINGS_load()
+{
+    bool foundValidRecord = false;
+    
+    //Find the newest valid record (an incomplete write, ex. from losing power, will fail the CRC)
+    for (uint_fast8_t slot = 0; slot < RECORD_COUNT; ++slot)
+    {
+        record_t record;
+        readRecord(slot, &record);
+        
+        bool valid = (record.sequence != EMPTY_SEQUENCE) &&
+                     (record.version == SETTINGS_VERSION) &&
+                     (record.crc == calculateCRC(&record));
+        
+        if (valid && (!foundValidRecord || isNewer(record.sequence, newestSequence)))
+        {
+            foundValidRecord = true;
+            newestSlot = slot;
+            newestSequence = record.sequence;
+            storedData = record.data;
+        }
+    }
+    
+    if (foundValidRecord)
+        SETTINGS_data = storedData;
+    else//Nothing is written until the settings are actually changed
+    {
+        SETTINGS_data.alarmEnabled = SETTINGS_DEFAULT_ALARM_ENABLED;
+        SETTINGS_data.clockTimeout = SETTINGS_DEFAULT_CLOCK_TIMEOUT;
+        storedData = SETTINGS_data;
+    }
+}
+
+void SETTINGS_save()
+{
+    if (!memcmp(&SETTINGS_data, &storedData, sizeof(SETTINGS_t)))
+        return;//Nothing changed
+    
+    //Append a record with every setting to the journal (overwriting the oldest one)
+    record_t record;
+    
+    ++newestSlot;
+    if (newestSlot == RECORD_COUNT)
+        newestSlot = 0;
+    
+    ++newestSequence;
+    if (newestSequence == EMPTY_SEQUENCE)
+        newestSequence = 0;
+    
+    record.sequence = newestSequence;
+    record.version = SETTINGS_VERSION;
+    record.data = SETTINGS_data;
+    memset(record.reserved, 0xFF, sizeof(record.reserved));
+    record.crc = calculateCRC(&record);
+    
+    //Writes are queued and performed in order, so the CRC is written last
+    const uint8_t* bytes = (const uint8_t*)&record;
+    uint16_t address = newestSlot * SETTINGS_RECORD_SIZE;
+    for (uint_fast8_t i = 0; i < SETTINGS_RECORD_SIZE; ++i)
+        EEPROM_write(bytes[i], address + i);
+    
+    storedData = SETTINGS_data;
+}
+
+/* Static Functions */
+
+static void readRecord(uint8_t slot, record_t* record)
+{
+    uint8_t* bytes = (uint8_t*)record;
+    uint16_t address = slot * SETTINGS_RECORD_SIZE;
+    
+    for (uint_fast8_t i = 0; i < SETTINGS_RECORD_SIZE; ++i)
+        bytes[i] = EEPROM_read(address + i);
+}
+
+static uint8_t calculateCRC(const record_t* record)
+{
+    const uint8_t* bytes = (const uint8_t*)record;
+    uint8_t crc = 0;
+    
+    for (uint_fast8_t i = 0; i < (SETTINGS_RECORD_SIZE - 1); ++i)//Everything except the CRC
+        crc = _crc8_ccitt_update(crc, bytes[i]);
+    
+    return crc;
+}
@@ -0,0 +1,69 @@
+/* Timer code
+ * By: John Jekel
+ *
+ * Uses Timer 2 to wait for a period of time while sleeping (idle mode) instead of busy-waiting,
+ * and to time out waits for other things.
+*/
+
+#include "timer.h"
+#include "power.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+//Constant Definitions
+
+//WGM2[2:0] = 0b010 (CTC mode, OCR2A as TOP)
+//CS2[2:0] = 0b111 (clk/1024)
+#define TCCR2A_SETTINGS 0b00000010
+#define TCCR2B_SETTINGS 0b00000111
+
+//Variables
+
+volatile bool TIMER_expired;
+
+//Functions
+
+void TIMER_sleepTicks(uint16_t ticks)
+{
+    while (ticks)
+    {
+        //The counter is 8 bits, so longer waits are done in chunks
+        uint16_t chunk = (ticks > TIMER_MAX_TIMEOUT_TICKS) ? TIMER_MAX_TIMEOUT_TICKS : ticks;
+        ticks -= chunk;
+        
+        TIMER_startTimeout(chunk);
+        POWER_idleUntil(&TIMER_expired);
+        TIMER_stopTimeout();
+    }
+}
+
+void TIMER_startTimeout(uint16_t ticks)
+{
+    PRR &= 0b10111111;//Enable timer 2
+    TCCR2A = TCCR2A_SETTINGS;
+    TIMSK2 = 0b00000010;//Enable the compare match A interrupt
+    
+    OCR2A = ticks - 1;
+    TCNT2 = 0;
+    GTCCR |= 1 << 1;//Reset the prescaler so the first tick is a full one
+    TIMER_expired = false;
+    TCCR2B = TCCR2B_SETTINGS;//Start counting
+}
+
+void TIMER_stopTimeout()
+{
+    TCCR2B = 0;//Stop counting
+    TIMSK2 = 0;
+    PRR |= 0b01000000;//Disable timer 2 again
+}
+
+//ISRs
+
+ISR(TIMER2_COMPA_vect)
+{
+    TIMER_expired = true;
+}
@@ -1,17 +1,32 @@
 #include "ui/alarm.h"
+#include "ui/clock.h"
 
 #include "rtc.h"
 #include "lcd.h"
 #include "buzzer.h"
+#include "scheduler.h"
+
+#include <stdint.h>
+
+static void toggleBuzzer();
 
 static bool buzzerEnabled;
+static SCHEDULER_timer_t beepTimer = {.callback = toggleBuzzer};
+static uint16_t alarmMinuteOfDay;//Cached from alarm 2 so ALARM_isDue doesn't need I2C
+
+void ALARM_cacheAlarmTime()
+{
+    alarmMinuteOfDay = RTC_minuteOfDay(RTC_fromBCD(RTC_registers.alarm2.hours),
+                                       RTC_fromBCD(RTC_registers.alarm2.minutes));
+}
 
 void ALARM_setup()
 {
     //Turn on the display
-    LCD_on();//Also sets display address to 0x00
+    LCD_on();
     
     //Update display to notify about alarm
+    LCD_clear();//The display may still be showing the clock
     LCD_setDisplayAddress(0x00);
     LCD_writeCharacter('\x6');
     char alarmSnippet[5];
@@ -23,43 +38,62 @@ void ALARM_setup()
     LCD_setDisplayAddress(0x40);
     LCD_printAmount_P(PSTR(ALARM_STRING), 16);
     
-    //Setup the buzzer
+    //Setup the buzzer; it beeps on and off every half second until ALARM_stop
     buzzerEnabled = false;
     buzzer_setFrequency(1000);
+    SCHEDULER_start(&beepTimer, 1, SCHEDULER_MS_TO_TICKS(500));
 }
 
-void ALARM_update()
+bool ALARM_isDue()
 {
-    if (buzzerEnabled)
-        buzzer_disable();
-    else
-        buzzer_enable();
+    uint16_t now = RTC_minuteOfDay(RTC_now.hours, RTC_now.minutes);
+    if (alarmMinuteOfDay == now)
+        return true;
     
-    buzzerEnabled = !buzzerEnabled;//Toggle buzzer every update period
+    //The time in RTC_now is one update behind the RTC when the alarm flag is set, so the next
+    //minute is also checked, but only on the last update before it (one flag read per alarm)
+    #if !CLOCK_MINUTE_RESOLUTION
+        if (RTC_now.seconds != 59)
+            return false;
+    #endif
+    
+    uint16_t nextMinute = (now == ((24 * 60) - 1)) ? 0 : (now + 1);
+    return alarmMinuteOfDay == nextMinute;
 }
 
 bool ALARM_match()//Checks if RTC alarm2 flag is set
 {
     RTC_refreshCSR();
-    return (RTC_getCSR() & (1 << 1)) != 0;
+    return RTC_registers.status.alarm2Flag;
 }
 
 void ALARM_stop()
 {
     //Clear RTC match flag
     RTC_refreshCSR();
-    RTC_setCSR(RTC_getCSR() & ~(1 << 1));//Clear alarm 2 flag
+    RTC_registers.status.alarm2Flag = 0;//Clear alarm 2 flag
     RTC_sendCSR();//Store back to RTC
     
     //Disable the buzzer
+    SCHEDULER_stop(&beepTimer);
     buzzer_disable();
 }
 
 void ALARM_fillBufferWithAlarmTimeSnippet(char alarmSnippet[5])
 {
-    alarmSnippet[0] = RTC_get10HoursA2() + '0';//Tens of hours (24 hour time)
-    alarmSnippet[1] = RTC_getHoursA2() + '0';//Hours
+    alarmSnippet[0] = RTC_registers.alarm2.hours.tens + '0';//Tens of hours (24 hour time)
+    alarmSnippet[1] = RTC_registers.alarm2.hours.units + '0';//Hours
     alarmSnippet[2] = ':';
-    alarmSnippet[3] = RTC_get10MinutesA2() + '0';//Tens of minutes
-    alarmSnippet[4] = RTC_getMinutesA2() + '0';//Minutes
+    alarmSnippet[3] = RTC_registers.alarm2.minutes.tens + '0';//Tens of minutes
+    alarmSnippet[4] = RTC_registers.alarm2.minutes.units + '0';//Minutes
+}
+
+static void toggleBuzzer()
+{
+    if (buzzerEnabled)
+        buzzer_disable();
+    else
+        buzzer_enable();
+    
+    buzzerEnabled = !buzzerEnabled;
 }
@@ -2,6 +2,7 @@
 #include "rtc.h"
 #include "lcd.h"
 
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Constants and static variables */
@@ -13,30 +14,53 @@ static char bottomLine[16] = "\x5  /  /2       .";
 
 /* Static Functions */
 
+static void printTime()
+{
+    LCD_setDisplayAddress(0x01);
+    
+    #if CLOCK_MINUTE_RESOLUTION
+        LCD_printAmount(topLine + 1, 5);//Hours and minutes only
+        LCD_printAmount_P(PSTR("   "), 3);
+    #else
+        LCD_printAmount(topLine + 1, 8);
+    #endif
+}
+
+#if CLOCK_MINUTE_RESOLUTION
+static void clearMinuteAlarmFlag()
+{
+    //The ~INT pin stays low until the alarm 1 flag is cleared, so we wouldn't get another edge
+    //NOTE: Writing a 1 to the alarm 2 flag leaves it unchanged, so it can't be lost here
+    RTC_refreshCSR();
+    RTC_registers.status.alarm1Flag = 0;//Clear alarm 1 flag
+    RTC_sendCSR();
+}
+#endif
+
 static void updateTime()
 {
-    topLine[1] = RTC_get10Hours() + '0';//Tens of hours (24 hour time)
-    topLine[2] = RTC_getHours() + '0';//Hours
-    topLine[4] = RTC_get10Minutes() + '0';//Tens of minutes
-    topLine[5] = RTC_getMinutes() + '0';//Minutes
-    topLine[7] = RTC_get10Seconds() + '0';//Tens of seconds
-    topLine[8] = RTC_getSeconds() + '0';//Seconds
+    topLine[1] = RTC_registers.hours.tens + '0';//Tens of hours (24 hour time)
+    topLine[2] = RTC_registers.hours.units + '0';//Hours
+    topLine[4] = RTC_registers.minutes.tens + '0';//Tens of minutes
+    topLine[5] = RTC_registers.minutes.units + '0';//Minutes
+    topLine[7] = RTC_registers.seconds.tens + '0';//Tens of seconds
+    topLine[8] = RTC_registers.seconds.units + '0';//Seconds
 }
 
 static void updateDateAndDay()
 {
-    bottomLine[1] = RTC_get10Date() + '0';//Tens of days
-    bottomLine[2] = RTC_getDate() + '0';//Day
-    bottomLine[4] = RTC_get10Months() + '0';//Tens of months
-    bottomLine[5] = RTC_getMonths() + '0';//Months
-    bottomLine[8] = RTC_getCenturies() + '0';//Century
-    bottomLine[9] = RTC_get10Years() + '0';//Tens of years
-    bottomLine[10] = RTC_getYears() + '0';//Years
+    bottomLine[1] = RTC_registers.date.tens + '0';//Tens of days
+    bottomLine[2] = RTC_registers.date.units + '0';//Day
+    bottomLine[4] = RTC_registers.month.tens + '0';//Tens of months
+    bottomLine[5] = RTC_registers.month.units + '0';//Months
+    bottomLine[8] = RTC_registers.month.century + '0';//Century
+    bottomLine[9] = RTC_registers.year.tens + '0';//Tens of years
+    bottomLine[10] = RTC_registers.year.units + '0';//Years
     
-    //Because RTC_getDay is 1-7, but we want 0-6, access RTC_dayStrings starting at a negative 
-    //index. Done at compile time, saving an instruction that would be needed to subtract 1 from 
-    //RTC_getDay
-    const char* dayOfWeek = (CLOCK_dayStrings - 1)[RTC_getDay()];
+    //Because the day register is 1-7, but we want 0-6, access RTC_dayStrings starting at a
+    //negative index. Done at compile time, saving an instruction that would be needed to subtract
+    //1 from the day
+    const char* dayOfWeek = (CLOCK_dayStrings - 1)[RTC_registers.day.day];
     memcpy_P(bottomLine + 12, dayOfWeek, 3);//Copy the 3 characters of the day to the buffer
 }
 
@@ -50,14 +74,14 @@ void CLOCK_setup()
     //Therefore, when switching back to CLOCK mode, we need to update them once so they aren't  
     //blank when the display turns on (because they're not being updated continuously like the)
     //seconds are.
-    RTC_refreshTimeAndDate();//For time, date and day
+    RTC_sync();//For time, date and day (also resynchronizes RTC_tick)
     RTC_refreshTempMSB();//For temperature
     
     //Update topLine and bottomLine buffers
     updateTime();
     updateDateAndDay();
     //Temperature
-    uint8_t temperature = RTC_getTemperatureMSB();//Just the integer part
+    uint8_t temperature = RTC_registers.temperature;//Just the integer part
     uint8_t temperatureWithoutSignBit = temperature & 0x7F;//Remove the sign bit
     topLine[12] = (temperature & 0x80) ? '-' : ' ';//Negative sign for negative temperatures
     topLine[13] = (temperatureWithoutSignBit / 10) + '0';
@@ -67,62 +91,36 @@ void CLOCK_setup()
     LCD_on();//Enable the display and backlight
     LCD_setDisplayAddress(0x00);//First line
     LCD_printAmount(topLine, 16);
+    printTime();
     LCD_setDisplayAddress(0x40);//Second line
     LCD_printAmount(bottomLine, 16);
+    
+    #if CLOCK_MINUTE_RESOLUTION
+        clearMinuteAlarmFlag();//It was likely set while we weren't in CLOCK mode
+    #endif
 }
 
 void CLOCK_update()
 {
-    RTC_refreshTime();//TODO refresh just needed digits for even better optimization (careful of rollover)
-    
-    LCD_setDisplayAddress(0x8);
-    uint8_t seconds = RTC_getSeconds();
-    LCD_writeCharacter(seconds + '0');//Seconds
+    //Advance the time in software; only occasionally reads from the RTC
+    #if CLOCK_MINUTE_RESOLUTION
+        clearMinuteAlarmFlag();
+        RTC_tickMinute();
+    #else
+        RTC_tick();
+    #endif
+    updateTime();
     
-    if (seconds == 0)//Seconds overflowed
+    //Check for midnight (the date and day of week change)
+    if (!RTC_now.hours && !RTC_now.minutes && !RTC_now.seconds)
     {
-        LCD_setDisplayAddress(0x7);
-        uint8_t seconds10 = RTC_get10Seconds();
-        LCD_writeCharacter(seconds10 + '0');//Tens of seconds
+        updateDateAndDay();//RTC_tick already advanced the date and day
         
-        if (seconds10 == 0)//Tens of seconds overflowed
-        {
-            LCD_setDisplayAddress(0x5);
-            uint8_t minutes = RTC_getMinutes();
-            LCD_writeCharacter(minutes + '0');//Minutes
-            
-            if (minutes == 0)//Minutes overflowed
-            {
-                LCD_setDisplayAddress(0x4);
-                uint8_t minutes10 = RTC_get10Minutes();
-                LCD_writeCharacter(minutes10 + '0');//Tens of minutes
-                
-                if (minutes10 == 0)//Tens of minutes overflowed
-                {
-                    LCD_setDisplayAddress(0x2);
-                    uint8_t hours = RTC_getHours();
-                    LCD_writeCharacter(hours + '0');//Hours
-                    
-                    if (hours == 0)//Hours overflowed
-                    {
-                        LCD_setDisplayAddress(0x1);
-                        uint8_t hours10 = RTC_get10Hours();
-                        LCD_writeCharacter(hours10 + '0');//Tens of hours
-                        
-                        if (hours10 == 0)//Tens of hours overflowed
-                        {
-                            //Update date and day of week
-                            RTC_refreshDateAndDay();
-                            updateDateAndDay();
-                            
-                            LCD_setDisplayAddress(0x41);
-                            LCD_printAmount(bottomLine + 1, 14);
-                        }
-                    }
-                }
-            }
-        }
+        LCD_setDisplayAddress(0x41);
+        LCD_printAmount(bottomLine + 1, 14);
     }
+    
+    printTime();//Only the digits that actually changed are sent when the LCD is flushed
 }
 
 //For menu code
@@ -137,16 +135,16 @@ void CLOCK_printTimeSnippet()
 void CLOCK_printDaySnippet()
 {
     LCD_setDisplayAddress(0x01);
-    //Because RTC_getDay is 1-7, but we want 0-6, access RTC_dayStrings starting at a negative 
-    //index. Done at compile time, saving an instruction that would be needed to subtract 1 from 
-    //RTC_getDay
-    const char* dayOfWeek = (CLOCK_dayStrings - 1)[RTC_getDay()];
+    //Because the day register is 1-7, but we want 0-6, access RTC_dayStrings starting at a
+    //negative index. Done at compile time, saving an instruction that would be needed to subtract
+    //1 from the day
+    const char* dayOfWeek = (CLOCK_dayStrings - 1)[RTC_registers.day.day];
     LCD_printAmount_P(dayOfWeek, 3);
 }
 
 void CLOCK_printDateAndDaySnippet()
 {
     LCD_setDisplayAddress(0x01);
-    updateDateAndDay((CLOCK_dayStrings - 1)[RTC_getDay()]);
+    updateDateAndDay((CLOCK_dayStrings - 1)[RTC_registers.day.day]);
     LCD_printAmount(bottomLine + 1, 10);
 }
@@ -4,6 +4,7 @@
 
 #include "rtc.h"
 #include "lcd.h"
+#include "settings.h"
 
 #include <avr/io.h>
 #include <avr/pgmspace.h>
@@ -58,10 +59,10 @@ static menuScreen_t currentMenuScreen;
 static bool menuScreenChanged;
 static uint8_t arrowPosition;//Only change this with moveArrow (reading is ok)
 
-//For ALARM (used to reduce EEPROM writes and to only apply the setting if enter is pressed)
+//For ALARM (used to only apply the setting if enter is pressed)
 static bool alarmEnableCache;
 
-//For TIMEOUT (used to reduce EEPROM writes and speed up menu code)
+//For TIMEOUT (used to only apply the setting if enter is pressed and speed up menu code)
 static uint8_t timeoutCache;
 static uint8_t timeout10Cache;
 
@@ -236,8 +237,8 @@ static void oneTime()
         }
         case TIMEOUT:
         {
-            //Refresh timeout cache from EEPROM
-            uint8_t currentTimeoutValue = EEPROM_read(1);
+            //Refresh timeout cache from the settings
+            uint8_t currentTimeoutValue = SETTINGS_data.clockTimeout;
             timeoutCache = (currentTimeoutValue % 10);//1s column
             timeout10Cache = (currentTimeoutValue / 10);//10s column
             
@@ -304,6 +305,7 @@ static void enterButtonResponse()
         case ALARM:
         {
             RTC_sendA2();//Update alarm 2 in the RTC
+            ALARM_cacheAlarmTime();
             
             if (alarmEnableCache)
                 ALARM_enable();
@@ -337,7 +339,7 @@ static void enterButtonResponse()
             if (!newValue)
                 ++newValue;//Minimum of 1
             
-            EEPROM_write(newValue, 1);
+            SETTINGS_data.clockTimeout = newValue;//Saved once the menu is exited
             
             break;
         }
@@ -358,19 +360,19 @@ static uint8_t getValueAtArrowPosition()
             {
                 case 1:
                 {
-                    return RTC_get10HoursA2();
+                    return RTC_registers.alarm2.hours.tens;
                 }
                 case 2:
                 {
-                    return RTC_getHoursA2();
+                    return RTC_registers.alarm2.hours.units;
                 }
                 case 4:
                 {
-                    return RTC_get10MinutesA2();
+                    return RTC_registers.alarm2.minutes.tens;
                 }
                 case 5:
                 {
-                    return RTC_getMinutesA2();
+                    return RTC_registers.alarm2.minutes.units;
                 }
                 case 6:
                 {
@@ -385,27 +387,27 @@ static uint8_t getValueAtArrowPosition()
             {
                 case 1:
                 {
-                    return RTC_get10Hours();
+                    return RTC_registers.hours.tens;
                 }
                 case 2:
                 {
-                    return RTC_getHours();
+                    return RTC_registers.hours.units;
                 }
                 case 4:
                 {
-                    return RTC_get10Minutes();
+                    return RTC_registers.minutes.tens;
                 }
                 case 5:
                 {
-                    return RTC_getMinutes();
+                    return RTC_registers.minutes.units;
                 }
                 case 7:
                 {
-                    return RTC_get10Seconds();
+                    return RTC_registers.seconds.tens;
                 }
                 case 8:
                 {
-                    return RTC_getSeconds();
+                    return RTC_registers.seconds.units;
                 }
             }
             break;
@@ -416,38 +418,38 @@ static uint8_t getValueAtArrowPosition()
             {
                 case 1:
                 {
-                    return RTC_get10Date();
+                    return RTC_registers.date.tens;
                 }
                 case 2:
                 {
-                    return RTC_getDate();
+                    return RTC_registers.date.units;
                 }
                 case 4:
                 {
-                    return RTC_get10Months();
+                    return RTC_registers.month.tens;
                 }
                 case 5:
                 {
-                    return RTC_getMonths();
+                    return RTC_registers.month.units;
                 }
                 case 8:
                 {
-                    return RTC_getCenturies();
+                    return RTC_registers.month.century;
                 }
                 case 9:
                 {
-                    return RTC_get10Years();
+                    return RTC_registers.year.tens;
                 }
                 case 10:
                 {
-                    return RTC_getYears();
+                    return RTC_registers.year.units;
                 }
             }
             break;
         }
         case DAY:
         {
-            return RTC_getDay();
+            return RTC_registers.day.day;
             break;
         }
         case TIMEOUT:
@@ -478,22 +480,22 @@ static void setValueAtArrowPosition(uint8_t value)
             {
                 case 1:
                 {
-                    RTC_set10HoursA2(value);
+                    RTC_registers.alarm2.hours.tens = value;
                     break;
                 }
                 case 2:
                 {
-                    RTC_setHoursA2(value);
+                    RTC_registers.alarm2.hours.units = value;
                     break;
                 }
                 case 4:
                 {
-                    RTC_set10MinutesA2(value);
+                    RTC_registers.alarm2.minutes.tens = value;
                     break;
                 }
                 case 5:
                 {
-                    RTC_setMinutesA2(value);
+                    RTC_registers.alarm2.minutes.units = value;
                     break;
                 }
                 case 6:
@@ -511,32 +513,32 @@ static void setValueAtArrowPosition(uint8_t value)
             {
                 case 1:
                 {
-                    RTC_set10Hours(value);
+                    RTC_registers.hours.tens = value;
                     break;
                 }
                 case 2:
                 {
-                    RTC_setHours(value);
+                    RTC_registers.hours.units = value;
                     break;
                 }
                 case 4:
                 {
-                    RTC_set10Minutes(value);
+                    RTC_registers.minutes.tens = value;
                     break;
                 }
                 case 5:
                 {
-                    RTC_setMinutes(value);
+                    RTC_registers.minutes.units = value;
                     break;
                 }
                 case 7:
                 {
-                    RTC_set10Seconds(value);
+                    RTC_registers.seconds.tens = value;
                     break;
                 }
                 case 8:
                 {
-                    RTC_setSeconds(value);
+                    RTC_registers.seconds.units = value;
                     break;
                 }
             }
@@ -548,37 +550,37 @@ static void setValueAtArrowPosition(uint8_t value)
             {
                 case 1:
                 {
-                    RTC_set10Date(value);
+                    RTC_registers.date.tens = value;
                     break;
                 }
                 case 2:
                 {
-                    RTC_setDate(value);
+                    RTC_registers.date.units = value;
                     break;
                 }
                 case 4:
                 {
-                    RTC_set10Months(value);
+                    RTC_registers.month.tens = value;
                     break;
                 }
                 case 5:
                 {
-                    RTC_setMonths(value);
+                    RTC_registers.month.units = value;
                     break;
                 }
                 case 8:
                 {
-                    RTC_setCenturies(value);
+                    RTC_registers.month.century = value;
                     break;
                 }
                 case 9:
                 {
-                    RTC_set10Years(value);
+                    RTC_registers.year.tens = value;
                     break;
                 }
                 case 10:
                 {
-                    RTC_setYears(value);
+                    RTC_registers.year.units = value;
                     break;
                 }
             }
@@ -586,7 +588,7 @@ static void setValueAtArrowPosition(uint8_t value)
         }
         case DAY:
         {
-            RTC_setDay(value);
+            RTC_registers.day.day = value;
             break;
         }
         case TIMEOUT:
@@ -615,14 +617,14 @@ bool boundsCheckArrowPosition(uint8_t newValue)
             {
                 case ALARM:
                 {
-                    if ((newValue == 2) && (RTC_getHoursA2() > 3))//TODO make not awful (make some sort of more regular way of doing this maybe)
+                    if ((newValue == 2) && (RTC_registers.alarm2.hours.units > 3))//TODO make not awful (make some sort of more regular way of doing this maybe)
                         return false;//Cant allow 24:00 and above (ex. 29:00)
                     else
                         return newValue < 3;//Tens of hours (24 hour time)
                 }
                 case TIME:
                 {
-                    if ((newValue == 2) && (RTC_getHours() > 3))//TODO make not awful (make some sort of more regular way of doing this maybe)
+                    if ((newValue == 2) && (RTC_registers.hours.units > 3))//TODO make not awful (make some sort of more regular way of doing this maybe)
                         return false;//Cant allow 24:00 and above (ex. 29:00)
                     else
                         return newValue < 3;//Tens of hours (24 hour time)
@@ -648,14 +650,14 @@ bool boundsCheckArrowPosition(uint8_t newValue)
             {
                 case ALARM:
                 {
-                    if (RTC_get10HoursA2() < 2)//TODO make not awful (make some sort of more regular way of doing this maybe)
+                    if (RTC_registers.alarm2.hours.tens < 2)//TODO make not awful (make some sort of more regular way of doing this maybe)
                         return newValue < 10;//Base 10
                     else
                         return newValue < 4;//Max of 23:59 hours
                 }
                 case TIME:
                 {
-                    if (RTC_get10Hours() < 2)//TODO make not awful (make some sort of more regular way of doing this maybe)
+                    if (RTC_registers.hours.tens < 2)//TODO make not awful (make some sort of more regular way of doing this maybe)
                         return newValue < 10;//Base 10
                     else
                         return newValue < 4;//Max of 23:59 hours
@@ -8,126 +8,236 @@
 #include "lcd.h"
 #include "buzzer.h"
 #include "i2c.h"
+#include "settings.h"
 #include "eeprom.h"
+#include "scheduler.h"
+#include "profile.h"
+#include "power.h"
 
 #include <avr/io.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
 
 /* Constants/Macros and Typedefs */
 
-typedef enum {CLOCK, SLEEP, MENU, ALARM} mode_t;
-typedef enum {INIT, BUTTON, RTC_INTERRUPT} wakeupReason_t;
+//The hidden STATS mode shows the results of whichever instrumentation is compiled in
+#if defined(PROFILE)
+    #define HAS_STATS 1
+    #define getStatsPageCount PROFILE_getPageCount
+    #define drawStatsPage PROFILE_drawPage
+#elif defined(POWER_ACCOUNTING)
+    #define HAS_STATS 1
+    #define getStatsPageCount POWER_getPageCount
+    #define drawStatsPage POWER_drawPage
+#elif defined(I2C_STATS)
+    #define HAS_STATS 1
+    #define getStatsPageCount I2C_getPageCount
+    #define drawStatsPage I2C_drawPage
+#else
+    #define HAS_STATS 0
+#endif
 
-#define clockTimeout (EEPROM_read(1))
+typedef enum
+{
+    CLOCK, SLEEP, MENU, ALARM,
+    #if HAS_STATS
+        STATS,//Hidden; shows PROFILE/POWER_ACCOUNTING/I2C_STATS results (LEFT + RIGHT in the MENU)
+    #endif
+    MODE_COUNT
+} mode_t;
+typedef enum {INIT, BUTTON, RTC_INTERRUPT} wakeupReason_t;//INIT also means no event
 
-/* Static Variables */
+typedef struct
+{
+    wakeupReason_t source;
+    uint8_t portD;//PIND captured by the ISR (the buttons)
+    uint16_t tick;//Number of RTC interrupts before this event (only for debugging; not read)
+} event_t;
+
+//What an event means to the current mode; these index each mode's transition table
+typedef enum
+{
+    NO_TRIGGER, BUTTON_PUSH, BUTTON_RELEASE, RTC_TICK, TIMEOUT, ALARM_MATCH, MENU_EXIT,
+    #if HAS_STATS
+        STATS_COMBO,//LEFT and RIGHT pushed together
+    #endif
+    TRIGGER_COUNT
+} trigger_t;
 
-static mode_t currentMode = CLOCK;//Start with displaying time and date
-static bool updatedMode = true;//The mode was changed (from no previous mode in this case)
+//Transition table entries are the next mode + 1, so entries left out mean no transition
+#define TO(mode) ((mode) + 1)
+#define NO_TRANSITION 0
 
-static volatile wakeupReason_t wakeupReason = INIT;
+//Mode flags (decide which triggers the mode can see)
+#define COUNTS_TIMEOUT 0b00000001//RTC interrupts count towards clockTimeout, then TIMEOUT
+#define CHECKS_ALARM 0b00000010//RTC interrupts check the alarm flag, giving ALARM_MATCH
+#define ALARM_ONLY_WHEN_DUE 0b00000100//Only check the flag when ALARM_isDue (needs CLOCK_update)
+#define EXITS_WHEN_READY 0b00001000//Button events give MENU_EXIT once MENU_readyToExit
+#define SETUP_HANDLES_ENTRY 0b00010000//The event that entered the mode isn't passed to update
 
-static volatile uint8_t portDCapture = 0;//Updated whenever we emerge from sleep
+typedef struct
+{
+    uint8_t rtcControl;//Sent to the RTC on entry; decides what fires INT0 in this mode
+    uint8_t flags;
+    void (*setup)();//Called on entry (may be NULL)
+    void (*update)(const event_t* event);//Called for every event while in this mode (may be NULL)
+    void (*exit)();//Called before leaving (may be NULL)
+    uint8_t transitions[TRIGGER_COUNT];//TO(next mode) for each trigger, or NO_TRANSITION
+} modeDescriptor_t;
+
+#define EVENT_QUEUE_LENGTH 8//Must be a power of 2
 
-/* Static Function Definitions */
+#define clockTimeout (SETTINGS_data.clockTimeout)
+
+/* Static Function Declarations */
 
 static void sleepUntilInterrupt();
-static void decideNextMode();
+static void nextEvent();
+static trigger_t classifyEvent();
+static void enterMode(mode_t mode);
+static bool eventQueueIsEmpty();
+static void pushEvent(wakeupReason_t source);
+
+static void updateClock(const event_t* event);
+static void updateMenu(const event_t* event);
+static void exitMenu();
+#if HAS_STATS
+    static void setupStats();
+    static void updateStats(const event_t* event);
+#endif
+
+/* Mode Table */
+
+//Adding a mode only means adding a row here (and its handlers)
+static const modeDescriptor_t modeTable[MODE_COUNT] PROGMEM =
+{
+    [CLOCK] =//Display time, date, day of week, alarm symbol, and temperature
+    {
+        #if CLOCK_MINUTE_RESOLUTION
+            .rtcControl = 0b00000101,//Enable alarm 1 interrupt (RTC_init sets it to once a minute)
+        #else
+            .rtcControl = 0b00000010,//Enable 1hz output on ~INT/SQW pin (PD2/EXTI0)
+        #endif
+        //CLOCK_setup reads the time, so an RTC interrupt that entered CLOCK (eg. the STATS
+        //timeout) mustn't also advance it with CLOCK_update
+        .flags = COUNTS_TIMEOUT | CHECKS_ALARM | ALARM_ONLY_WHEN_DUE | SETUP_HANDLES_ENTRY,
+        .setup = CLOCK_setup,
+        .update = updateClock,
+        .exit = NULL,
+        .transitions = {[BUTTON_PUSH] = TO(MENU), [TIMEOUT] = TO(SLEEP), [ALARM_MATCH] = TO(ALARM)}
+    },
+    [SLEEP] =//Low power mode until alarm or button push
+    {
+        .rtcControl = 0b00000110,//Enable alarm 2 interrupt (to save more power)
+        .flags = CHECKS_ALARM,
+        .setup = LCD_off,
+        .update = NULL,
+        .exit = NULL,
+        .transitions =
+        {
+            [BUTTON_PUSH] = TO(CLOCK), [BUTTON_RELEASE] = TO(CLOCK), [ALARM_MATCH] = TO(ALARM)
+        }
+    },
+    [MENU] =//Change settings
+    {
+        .rtcControl = 0b00000110,//Enable alarm 2 interrupt (to save more power)
+        .flags = EXITS_WHEN_READY,
+        .setup = MENU_setup,
+        .update = updateMenu,
+        .exit = exitMenu,
+        .transitions =
+        {
+            [MENU_EXIT] = TO(CLOCK),
+            #if HAS_STATS
+                [STATS_COMBO] = TO(STATS)
+            #endif
+        }
+    },
+    [ALARM] =//Alarm interrupt occurred; the buzzer is toggled by a scheduler timer
+    {
+        .rtcControl = 0b00000110,//Enable alarm 2 interrupt (the square wave isn't needed)
+        .flags = 0,
+        .setup = ALARM_setup,
+        .update = NULL,
+        .exit = ALARM_stop,//Stop alarm from firing again and turn off buzzer
+        .transitions = {[BUTTON_PUSH] = TO(CLOCK), [BUTTON_RELEASE] = TO(CLOCK)}
+    },
+    #if HAS_STATS
+        [STATS] =//Instrumentation results; UP/DOWN change the page
+        {
+            .rtcControl = 0b00000010,//Enable 1hz output on ~INT/SQW pin (PD2/EXTI0) for the timeout
+            .flags = COUNTS_TIMEOUT,
+            .setup = setupStats,
+            .update = updateStats,
+            .exit = NULL,
+            .transitions = {[TIMEOUT] = TO(CLOCK), [STATS_COMBO] = TO(CLOCK)}
+        }
+    #endif
+};
+
+/* Static Variables */
+
+static mode_t currentMode;
+static modeDescriptor_t currentDescriptor;//RAM copy of modeTable[currentMode] (no flash reads)
+static uint8_t timeoutCounter;//Used to decide if it's time to SLEEP; reset on every mode change
+
+//Single producer (the ISRs, which can't interrupt each other), single consumer (nextEvent)
+static event_t eventQueue[EVENT_QUEUE_LENGTH];
+static volatile uint8_t eventQueueHead = 0;//Only written by the ISRs
+static volatile uint8_t eventQueueTail = 0;//Only written by nextEvent
+static volatile uint16_t rtcTickCount = 0;//Only for debugging (stamped into each event)
+
+static event_t currentEvent = {INIT, 0xFF, 0};//The event being handled this loop
 
 /* Public Functions */
 
 //Performs all important clock functions
-//Constantly loops through, checking buttons, updating screen, checking clock continuously
+//Each event is classified into a trigger for the current mode, which may change the mode (through
+//the mode table) before the mode's update handler sees the event
 void UI_scheduler()
 {
+    enterMode(CLOCK);//Start with displaying time and date
+    
     while (true)
     {
-        //Things that only need to happen when the mode changes
-        if (updatedMode)
+        //Events that arrived while we were awake are handled right away without sleeping, so
+        //the display is flushed and the MCU sleeps once per batch of events
+        if (eventQueueIsEmpty() && !SCHEDULER_isPending())
         {
-            //RTC EXTI0 configuration
-            switch (currentMode)
-            {
-                case CLOCK:
-                case ALARM:
-                {
-                    //Square wave used for reading RTC synchronously with time and beeping once/second
-                    RTC_setControl(0b00000010);//Enable 1hz output on ~INT/SQW pin (PD2/EXTI0)
-                    break;
-                }
-                case SLEEP:
-                case MENU:
-                {
-                    RTC_setControl(0b00000110);//Enable alarm 2 interrupt (to save more power)
-                    break;
-                }
-            }
-            
-            RTC_sendControl();//Apply settings set above to RTC
-            
-            //Mode specific code
-            switch (currentMode)
-            {
-                case CLOCK:
-                {
-                    //For the clock display to look right, we must reinitialize the display
-                    //This is because not everything is updated every second (and there might
-                    //be garbage left/the screen might be off)
-                    CLOCK_setup();
-                    break;
-                }
-                case SLEEP:
-                {
-                    //Save power during sleep
-                    LCD_off();
-                    break;
-                }
-                case MENU:
-                {
-                    MENU_setup();
-                    break;
-                }
-                case ALARM:
-                {
-                    ALARM_setup();
-                    break;
-                }
-            }
+            RTC_commit();//Write every RTC register changed since the last sleep
+            LCD_flush();//Send everything drawn since the last sleep to the display in one go
+            sleepUntilInterrupt();
+            RTC_invalidateVolatile();//The time, flags and temperature may have changed since
+        }
+        
+        SCHEDULER_run();//Run the callbacks of any software timers that expired
+        nextEvent();
+        
+        uint8_t transition = currentDescriptor.transitions[classifyEvent()];
+        PROFILE_markDecided();
+        
+        bool entered = transition != NO_TRANSITION;
+        if (entered)
+        {
+            if (currentDescriptor.exit)
+                currentDescriptor.exit();
             
-            updatedMode = false;//Finished with first time mode code
+            enterMode(transition - 1);
         }
         
-        //Things that must happen every loop
-        switch (currentMode)
+        bool skipUpdate = entered && (currentDescriptor.flags & SETUP_HANDLES_ENTRY);
+        if (currentDescriptor.update && !skipUpdate)
         {
-            case CLOCK://Display time, date, day of week, alarm symbol, and temperature
-            {
-                if (!updatedMode)//The mode switch code above handles the first time for us
-                    CLOCK_update();
-                break;
-            }
-            case SLEEP://Low power mode until alarm or button push
-            {
-                //No need to do anything (we will only wake up now for an alarm/button push)
-                break;
-            }
-            case MENU://Change settings
-            {
-                MENU_update(portDCapture);
-                break;
-            }
-            case ALARM://Alarm interrupt occurred
-            {
-                ALARM_update();
-                break;
-            }
+            PROFILE_markHandlerStart();
+            currentDescriptor.update(&currentEvent);
+            PROFILE_markUpdateDone(currentMode);
         }
-            
-        sleepUntilInterrupt();
         
-        decideNextMode();
+        PROFILE_markHandled(currentEvent.source);
     }
 }
 
@@ -144,13 +254,31 @@ static void sleepUntilInterrupt()
         PORTB &= ~(1 << 5);//TEST how MCU is awake (LED is active low)
     #endif
     
+    I2C_waitUntilIdle();//Finish any background transfers before turning off the peripheral
     I2C_peripheralDisable();
+    EEPROM_waitUntilIdle();//EE_READY can't wake us from power down, so finish queued writes now
     
     cli();//Disable BOD before sleep
-    MCUCR |= 0b01100000;//Start of timed sequence
-    MCUCR |= 0b01000000;
+    
+    //An event may have arrived while finishing up; if so, handle it instead of sleeping
+    //Interrupts that don't give an event or a timer tick (eg. timer 0 for POWER_ACCOUNTING) just
+    //put us back to sleep
+    //The watchdog (scheduler) runs in power down, so timers don't limit the sleep mode
+    while (eventQueueIsEmpty() && !SCHEDULER_isPending())
+    {
+        PROFILE_markSleep(currentMode);
+        POWER_accountSleep();
+        
+        MCUCR |= 0b01100000;//Start of timed sequence
+        MCUCR |= 0b01000000;
+        sei();
+        sleep_cpu();//Blocks until interrupt fires (end of BOD timed sequence)
+        
+        POWER_accountWake();
+        cli();
+    }
+    
     sei();
-    __asm__ __volatile__ ("sleep");//Blocks until interrupt fires (end of BOD timed sequence)
     
     I2C_peripheralEnable();
     
@@ -159,104 +287,112 @@ static void sleepUntilInterrupt()
     #endif
 }
 
-static void decideNextMode()//Polls buttons and alarms to decide on next mode
+static void nextEvent()//Takes the oldest event from the queue
 {
-    static uint8_t timeoutCounter = 0;//Used to decide if it's time to SLEEP
-    
-    switch (wakeupReason)
+    if (eventQueueIsEmpty())
+    {
+        currentEvent.source = INIT;//Nothing happened (eg. only a software timer woke us up)
+        currentEvent.portD = 0xFF;//So no button looks pushed (they are active low)
+    }
+    else
+    {
+        uint8_t tail = eventQueueTail;
+        currentEvent = eventQueue[tail];
+        //eventQueue isn't volatile, so keep the copy from being moved after the slot is freed
+        __asm__ __volatile__ ("" ::: "memory");
+        eventQueueTail = (tail + 1) & (EVENT_QUEUE_LENGTH - 1);
+    }
+}
+
+static trigger_t classifyEvent()//Decides what currentEvent means to the current mode
+{
+    switch (currentEvent.source)
     {
         case BUTTON://Push or release (pin change)
         {
-            switch (currentMode)
-            {
-                case ALARM://Does not matter whether button was pushed or released
-                {
-                    ALARM_stop();//Stop alarm from firing again and turn off buzzer
-                }//Fallthrough
-                case SLEEP://Does not matter whether button was pushed or released
-                {
-                    currentMode = CLOCK;//Exit to clock display
-                    updatedMode = true;
-                    timeoutCounter = 0;//Reset timeout counter for CLOCK
-                    break;
-                }
-                case CLOCK:
-                {
-                    bool aButtonWasPushed = ((~portDCapture) & 0b11110011) != 0;
-                    if (aButtonWasPushed)//A button was pushed (not released)
-                    {
-                        //Must only trigger when a button was pushed, otherwise releasing a button
-                        //after coming out of SLEEP would trigger the MENU
-                        currentMode = MENU;
-                        updatedMode = true;
-                    }
-                    
-                    break;
-                }
-                case MENU:
-                {
-                    //MENU_readyToExit will be updated to true when exit or the last enter is pushed
-                    //We will only see that it is true here however after it is released, because
-                    //the flag only updates after a call to MENU_update, which happens before the
-                    //sleep after the push.
-                    if (MENU_readyToExit())
-                    {
-                        MENU_clearExitFlag();
-                        currentMode = CLOCK;//Exit to clock display
-                        updatedMode = true;
-                        timeoutCounter = 0;//Reset timeout counter for CLOCK
-                    }
-                    break;
-                }
-                default:
-                {
-                    break;
-                }
-            }
+            //MENU_readyToExit will be updated to true when exit or the last enter is pushed
+            //We will only see that it is true here however after it is released, because
+            //the flag only updates after a call to MENU_update, which happens after the
+            //transition for the push.
+            if ((currentDescriptor.flags & EXITS_WHEN_READY) && MENU_readyToExit())
+                return MENU_EXIT;
+            
+            #if HAS_STATS
+                if (((~currentEvent.portD) & 0b00000011) == 0b00000011)//LEFT and RIGHT
+                    return STATS_COMBO;
+            #endif
             
-            break;
+            //Releases are kept separate, otherwise releasing a button after coming out of SLEEP
+            //would trigger the MENU
+            bool aButtonWasPushed = ((~currentEvent.portD) & 0b11110011) != 0;
+            return aButtonWasPushed ? BUTTON_PUSH : BUTTON_RELEASE;
         }
-        case RTC_INTERRUPT:
+        case RTC_INTERRUPT://Seconds, or minutes if CLOCK_MINUTE_RESOLUTION is enabled, or alarm 2
         {
-            switch (currentMode)
+            bool timedOut = false;
+            if (currentDescriptor.flags & COUNTS_TIMEOUT)
             {
-                case CLOCK:
-                {
-                    if (timeoutCounter >= clockTimeout)
-                    {
-                        currentMode = SLEEP;//Only keep display on for clockTimeout # of updates
-                        updatedMode = true;
-                    }
-                    else
-                        ++timeoutCounter;
-                }//Fallthrough
-                case SLEEP:
-                {
-                    if (ALARM_isEnabled())
-                    {
-                        if (ALARM_match())//Poll alarm
-                        {
-                            currentMode = ALARM;//Override mode with ALARM
-                            updatedMode = true;
-                        }
-                    }
-                    break;
-                }
-                default:
-                {
-                    break;
-                }
+                if (timeoutCounter >= clockTimeout)
+                    timedOut = true;//Only keep display on for clockTimeout # of updates
+                else
+                    ++timeoutCounter;
             }
-            break;
+            
+            //In CLOCK mode, only poll the RTC's alarm flag (an I2C read) when the time
+            //CLOCK_update already has is close to the alarm time. In SLEEP mode the RTC interrupt
+            //only fires for alarm 2 matches, so the flag is always checked.
+            if ((currentDescriptor.flags & CHECKS_ALARM) && ALARM_isEnabled())
+            {
+                bool checkFlag = !(currentDescriptor.flags & ALARM_ONLY_WHEN_DUE) || ALARM_isDue();
+                if (checkFlag && ALARM_match())
+                    return ALARM_MATCH;//Overrides the timeout
+            }
+            
+            return timedOut ? TIMEOUT : RTC_TICK;
         }
         case INIT:
         default:
         {
-            break;
+            return NO_TRIGGER;
         }
     }
 }
 
+static void enterMode(mode_t mode)
+{
+    currentMode = mode;
+    memcpy_P(&currentDescriptor, &modeTable[mode], sizeof(modeDescriptor_t));
+    timeoutCounter = 0;
+    PROFILE_markHandlerStart();
+    
+    RTC_registers.control.value = currentDescriptor.rtcControl;
+    RTC_sendControl();//Apply the mode's interrupt settings to the RTC
+    
+    if (currentDescriptor.setup)
+        currentDescriptor.setup();
+    
+    PROFILE_markSetupDone(mode);
+}
+
+static bool eventQueueIsEmpty()
+{
+    return eventQueueHead == eventQueueTail;
+}
+
+static void pushEvent(wakeupReason_t source)//Only call from ISRs
+{
+    uint8_t head = eventQueueHead;
+    uint8_t nextHead = (head + 1) & (EVENT_QUEUE_LENGTH - 1);
+    
+    if (nextHead == eventQueueTail)
+        return;//Full; should never happen since the main loop handles events much faster
+    
+    eventQueue[head].source = source;
+    eventQueue[head].portD = PIND;//Poll the buttons as soon as we awake from sleep
+    eventQueue[head].tick = rtcTickCount;
+    eventQueueHead = nextHead;
+}
+
 //ISRs
 
 //Fires once per second by RTC 1hz output
@@ -265,14 +401,64 @@ static void decideNextMode()//Polls buttons and alarms to decide on next mode
 //Also set to fire when an alarm match occurs during SLEEP and MENU
 ISR(INT0_vect)
 {
-    wakeupReason = RTC_INTERRUPT;
+    PROFILE_markWake();
+    pushEvent(RTC_INTERRUPT);
+    ++rtcTickCount;
     return;//Exit sleep and return to loop
 }
 
 //Occurs whenever a button changes state
 ISR(PCINT2_vect)
 {
-    portDCapture = PIND;//Poll the buttons as soon as we awake from sleep
-    wakeupReason = BUTTON;
+    PROFILE_markWake();
+    pushEvent(BUTTON);
     return;//Exit sleep and return to loop
 }
+
+//Mode handlers
+
+static void updateClock(const event_t* event)
+{
+    //Only update on RTC interrupts; CLOCK_update advances the time by a second (or minute)
+    //CLOCK_setup draws everything the first time
+    if (event->source == RTC_INTERRUPT)
+        CLOCK_update();
+}
+
+static void updateMenu(const event_t* event)
+{
+    MENU_update(event->portD);
+}
+
+static void exitMenu()
+{
+    MENU_clearExitFlag();
+    SETTINGS_save();//Everything changed in the menu is saved at once
+}
+
+#if HAS_STATS
+static uint8_t statsPage;
+
+static void setupStats()
+{
+    statsPage = 0;
+    drawStatsPage(statsPage);
+}
+
+static void updateStats(const event_t* event)
+{
+    if (event->source != BUTTON)
+        return;
+    
+    uint8_t pushed = (~event->portD) & 0b11110011;
+    if (pushed == (1 << 4))//UP
+        statsPage = (statsPage + 1) % getStatsPageCount();
+    else if (pushed == (1 << 5))//DOWN
+        statsPage = (statsPage ? statsPage : getStatsPageCount()) - 1;
+    else
+        return;
+    
+    timeoutCounter = 0;//Stay while the pages are being read
+    drawStatsPage(statsPage);
+}
+#endif